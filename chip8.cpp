@@ -3,65 +3,49 @@
 
 #include <stdint.h>
 #include <stdlib.h>
-#include <GLUT/glut.h>
-#include <fstream>
-#include <sys/stat.h>
+#include <string.h>
+#include <new>
 
-#include "inputs.cpp"
-
-#define pixelSize 10
+#include "chip8.h"
 
 using namespace std;
 
-long getFileSize(string filename)
-{
-    struct stat stat_buf;
-    int rc = stat(filename.c_str(), &stat_buf);
-    return rc == 0 ? stat_buf.st_size : -1;
+static inline uint64_t rotateRight(uint64_t value, int bits){
+    return bits == 0 ? value : (value >> bits) | (value << (64 - bits));
 }
 
-void drawPixel(int x, int y, int isOn){
-    if(isOn > 0){
-        glColor3f(1, 1, 1);
-    }
-    else {
-        glColor3f(0, 0, 0);
+// Fast 64-bit hash over whole words, used to compare machine states and frames
+static inline uint64_t hashWords(const uint64_t* words, size_t count){
+    uint64_t hash = 0x9E3779B97F4A7C15ull;
+    for(size_t ctr = 0; ctr < count; ctr++){
+        hash = (hash ^ words[ctr]) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
     }
-    glBegin(GL_QUADS);
-    glVertex2i(pixelSize * x, pixelSize * y);
-    glVertex2i(pixelSize * x, pixelSize * (y + 1));
-    glVertex2i(pixelSize * (x + 1), pixelSize * (y + 1));
-    glVertex2i(pixelSize * (x + 1), pixelSize * y);
-    glEnd();
+    return hash;
 }
 
-class Chip8 {
+static_assert(sizeof(Chip8State) == 4416, "Chip8State should stay compact");
+
+class Chip8 : public Chip8State {
     public:
 
-    ButtonKeys* inputKeys;
-    uint8_t ram[40696]; // 0x000 to 0x1FF: Default interpreter space (not usable) -> Start Programs at 0x200 (512 Bytes)
-    uint8_t v[16]; // V0 to VF are 8-bit general purpose registers. !!! VF must not be used by programs, because it is used for flags !!!
-    uint16_t i; // I is a 16-bit register used for memory addresses. Most often just the twelve lowest bits are used.
-    uint8_t st; // ST is a sound register -> A sound is played, when the register is not zero. In this case it also continiously decremented at a frequency of 60Hz
-    uint8_t dt; // DT is a delay register -> MORE INFORMATION ON DA WAY
-    uint16_t pc; // PC is the 16-bit program counter. it stores the currently executing address.
-    uint8_t sp; // SP is the 8-bit stack pointer and points to the topmost level of the stack.
-    uint16_t stack[16]; // The stack stores the 16-bit addresses the interpreter should return to when finishing subroutines. CHIP-8 allows for 16 levels of nested subroutines.
-    uint16_t inputMatrix; // this 16-bit Value shows which keys are active and which not.
-    bool screen[64 * 32]; // This represents a 64x32 monochrome screen
-    int decrementer;
-
-    Chip8(ButtonKeys* keys){
-        
-        inputKeys = keys;
-        decrementer = 16;
-        // Initialize registers
-        i = 0x0000;
-        st = 0x00;
-        dt = 0x00;
-        pc = 0x000;
-        sp = 0x00;
-        inputMatrix = 0x0000;
+    bool skipIdleLoops; // Don't execute spin loops that wait on the delay timer or a key
+    int instructionsPerFrame; // instructions executed between two 60Hz timer ticks
+    uint8_t quirks; // QUIRK_* switches for the behaviour the CHIP-8 variants disagree on
+
+    Chip8(){
+        instructionsPerFrame = 8;
+        skipIdleLoops = true;
+        quirks = QUIRK_SHIFT_VX | QUIRK_KEEP_I;
+        reset();
+    }
+
+    // Puts the machine state back to power-on: font and test program in RAM, everything else zero.
+    // The settings above are kept.
+    void reset(){
+        memset(static_cast<Chip8State*>(this), 0, sizeof(Chip8State));
+        decrementer = instructionsPerFrame;
+        seed = 0x2545F491;
 
         ram[0x000] = 0x12; // Skip save memory space
         ram[0x001] = 0x00;
@@ -244,76 +228,94 @@ class Chip8 {
     }
 
     void loadProgram(uint8_t code[]){
-        uint8_t saveSpace[0x200];
-        for (int ctr = 0; ctr < 0x200; ctr++){
-            saveSpace[ctr] = ram[ctr];
-        }
         for (int ctr = 0x200; ctr < 0xFFF; ctr++){
             ram[ctr] = code[ctr];
         }  
     }
 
-    void updateKeyPresses(){
-        inputMatrix = 0x0000;
-        if ((*inputKeys).a){
-            inputMatrix |= 0b0000000010000000;
-        }
-        if ((*inputKeys).q){
-            inputMatrix |= 0b0000000000010000;
-        }
-        if ((*inputKeys).one){
-            inputMatrix |= 0b0000000000000010;
-        }
-        if ((*inputKeys).y){
-            inputMatrix |= 0b0000010000000000;
-        }
-        if ((*inputKeys).two){
-            inputMatrix |= 0b0000000000000100;
-        }
-        if ((*inputKeys).w){
-            inputMatrix |= 0b0000000000100000;
-        }
-        if ((*inputKeys).s){
-            inputMatrix |= 0b0000000100000000;
-        }
-        if ((*inputKeys).x){
-            inputMatrix |= 0b0000000000000001;
-        }
-        if ((*inputKeys).three){
-            inputMatrix |= 0b0000000000001000;
-        }
-        if ((*inputKeys).e){
-            inputMatrix |= 0b0000000001000000;
-        }
-        if ((*inputKeys).d){
-            inputMatrix |= 0b0000001000000000;
+    uint16_t fetch(uint16_t address){
+        return ((uint16_t)ram[address & 0x0FFF] << 8) | ram[(address + 1) & 0x0FFF];
+    }
+
+    bool pixel(int x, int y){
+        return (screen[y] >> (63 - x)) & 1;
+    }
+
+    // Tells which RAM bytes an instruction reads or writes, apart from fetching it. False if it touches none.
+    bool memoryAccess(uint16_t instruction, uint16_t* address, uint8_t* length, bool* isWrite){
+        *address = i & 0x0FFF;
+        if ((instruction & 0xF000) == 0xD000){
+            *length = (instruction & 0x000F) + 1;
+            *isWrite = false;
+            return true;
         }
-        if ((*inputKeys).c){
-            inputMatrix |= 0b0000100000000000;
+        switch (instruction & 0xF0FF){
+            case 0xF033:
+                *length = 3;
+                *isWrite = true;
+                return true;
+            case 0xF055:
+                *length = 16;
+                *isWrite = true;
+                return true;
+            case 0xF065:
+                *length = 16;
+                *isWrite = false;
+                return true;
         }
-        if ((*inputKeys).four){
-            inputMatrix |= 0b0001000000000000;
+        return false;
+    }
+
+    // Checks whether a skip instruction would skip with the current registers and keys
+    bool wouldSkip(uint16_t instruction){
+        uint16_t savedPc = pc;
+        evaluateAndRun(instruction);
+        bool skipped = pc != savedPc;
+        pc = savedPc;
+        return skipped;
+    }
+
+    // Detects loops that cannot leave before the next timer tick, since nothing else changes meanwhile:
+    // FX07 / 3Xkk or 4Xkk / jump back,  EX9E or EXA1 / jump back  and  FX0A with no key held.
+    // Returns the size of the loop in bytes, 0 if the program is not waiting in one.
+    int idleLoopLength(){
+        if ((fetch(pc) & 0xF0FF) == 0xF00A && inputMatrix == 0){
+            return 2;
         }
-        if ((*inputKeys).r){
-            inputMatrix |= 0b0010000000000000;
+        if (pc > 0xFFA){
+            return 0;
         }
-        if ((*inputKeys).f){
-            inputMatrix |= 0b0100000000000000;
+        uint16_t first = fetch(pc);
+        uint16_t second = fetch(pc + 2);
+        uint16_t jumpBack = 0x1000 | pc;
+
+        if ((first & 0xF0FF) == 0xF007 && fetch(pc + 4) == jumpBack
+            && ((second & 0xF000) == 0x3000 || (second & 0xF000) == 0x4000)
+            && (second & 0x0F00) == (first & 0x0F00)){
+            uint8_t x = (uint8_t)((first & 0x0F00) >> 8);
+            uint8_t saved = v[x];
+            v[x] = dt;
+            bool leaves = wouldSkip(second);
+            v[x] = saved;
+            return leaves ? 0 : 6;
         }
-        if ((*inputKeys).v){
-            inputMatrix |= 0b1000000000000000;
+        if (((first & 0xF0FF) == 0xE09E || (first & 0xF0FF) == 0xE0A1) && second == jumpBack){
+            return wouldSkip(first) ? 0 : 4;
         }
+        return 0;
+    }
+
+    bool isIdleLoop(){
+        return idleLoopLength() > 0;
     }
 
     void runInstruction(){
-        uint16_t instruction = ((uint16_t)ram[pc] << 8) | ram[pc + 1];
+        uint16_t instruction = fetch(pc);
 
         switch(instruction){
             case 0x00E0:
-                for(int x = 0; x < 64; x++){
-                    for(int y = 0; y < 32; y++){
-                        screen[x + 64 * y] = false;
-                    }
+                for(int y = 0; y < 32; y++){
+                    screen[y] = 0;
                 }
                 break;
             case 0x00EE:
@@ -417,7 +419,7 @@ class Chip8 {
                         else{
                             v[0xF] = 0;
                         }
-                        v[secondNibble] = (uint8_t)(v[secondNibble] / 2);
+                        v[secondNibble] = (uint8_t)(v[(quirks & QUIRK_SHIFT_VX) ? secondNibble : thirdNibble] / 2);
                         break;
                     case 0x7:
                         if (v[thirdNibble] > v[secondNibble]){
@@ -435,7 +437,7 @@ class Chip8 {
                         else{
                             v[0xF] = 0;
                         }
-                        v[secondNibble] = v[secondNibble] * 2;
+                        v[secondNibble] = v[(quirks & QUIRK_SHIFT_VX) ? secondNibble : thirdNibble] * 2;
                         break;
                 }
                 break;
@@ -449,10 +451,13 @@ class Chip8 {
                 i = instruction & 0x0FFF;
                 break;
             case 0xB:
-                pc = (instruction & 0x0FFF) + v[0x0] - 0x0002;
+                pc = (instruction & 0x0FFF) + v[(quirks & QUIRK_JUMP_VX) ? secondNibble : 0x0] - 0x0002;
                 break;
             case 0xC:
-                v[secondNibble] = (uint8_t)(rand() % 256) & lastByte;
+                seed ^= seed << 13;    // xorshift32
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                v[secondNibble] = (uint8_t)(seed % 256) & lastByte;
                 break;
             case 0xD:
                 drawSprite(v[secondNibble], v[thirdNibble], lastNibble);
@@ -605,10 +610,11 @@ class Chip8 {
                         v[secondNibble] = dt;
                         break;
                     case 0x0A:
-                        while(inputMatrix == 0x0000){
-                            updateKeyPresses();
+                        if (inputMatrix == 0x0000){
+                            pc--;   // no key held yet, so wait by running this instruction again
+                            pc--;
                         }
-                        if ((inputMatrix & 0b1000000000000000) != 0b0000000000000000){
+                        else if ((inputMatrix & 0b1000000000000000) != 0b0000000000000000){
                             v[secondNibble] = 0x0F;
                         }
                         else if ((inputMatrix & 0b0100000000000000) != 0b0000000000000000){
@@ -681,18 +687,24 @@ class Chip8 {
                             tens++;
                         }
 
-                        ram[i] = (uint8_t)hundreds;
-                        ram[i + 0x0001] = (uint8_t)tens;
-                        ram[i + 0x0002] = (uint8_t)ones;
+                        ram[i & 0x0FFF] = (uint8_t)hundreds;
+                        ram[(i + 0x0001) & 0x0FFF] = (uint8_t)tens;
+                        ram[(i + 0x0002) & 0x0FFF] = (uint8_t)ones;
                         break;
                     case 0x55:
                         for(int in = 0; in < 16; in++){
-                            ram[i + in] = v[in];
+                            ram[(i + in) & 0x0FFF] = v[in];
+                        }
+                        if (!(quirks & QUIRK_KEEP_I)){
+                            i = i + secondNibble + 1;
                         }
                         break;
                     case 0x65:
                         for(int in = 0; in < 16; in++){
-                            v[in] = ram[i + in];
+                            v[in] = ram[(i + in) & 0x0FFF];
+                        }
+                        if (!(quirks & QUIRK_KEEP_I)){
+                            i = i + secondNibble + 1;
                         }
                         break;
                 }   
@@ -700,85 +712,105 @@ class Chip8 {
     }
 
     void drawSprite(uint8_t x, uint8_t y, uint8_t lines){
-        for(int line = 0; line <= lines; line++){
-            uint8_t byte = ram[i + line];
-            for(int i = 0; i < 8; i++){
-                if((x + i < 64) && (y +line < 32)){
-                    uint8_t bit;
-                    switch (i){
-                        case 0:
-                            bit = byte & 0b10000000;
-                            break;
-                        case 1:
-                            bit = byte & 0b01000000;
-                            break;
-                        case 2:
-                            bit = byte & 0b00100000;
-                            break;
-                        case 3:
-                            bit = byte & 0b00010000;
-                            break;
-                        case 4:
-                            bit = byte & 0b00001000;
-                            break;
-                        case 5:
-                            bit = byte & 0b00000100;
-                            break;
-                        case 6:
-                            bit = byte & 0b00000010;
-                            break;
-                        case 7:
-                            bit = byte & 0b00000001;
-                            break;
-                    }
-                    screen[x + i + (y + line)*64] = (bit > 0) ? true : false;
-                }
+        if(quirks & QUIRK_WRAP){
+            x &= 63;
+            y &= 31;
+            uint64_t mask = rotateRight(0xFF00000000000000ull, x);
+            for(int line = 0; line <= lines; line++){
+                uint64_t bits = rotateRight((uint64_t)ram[(i + line) & 0x0FFF] << 56, x);
+                screen[(y + line) & 31] = (screen[(y + line) & 31] & ~mask) | bits;
             }
+            return;
         }
-    }
-
-    void drawBuffer(){
-        for(int x = 0; x < 64; x++){
-            for(int y = 0; y < 32; y++){
-                if(screen[x + 64 * y]){
-                    drawPixel(x, y, 1);
-                }
-            }
+        if(x >= 64){
+            return;
+        }
+        uint64_t mask = 0xFF00000000000000ull >> x; // bits past the right edge get shifted out
+        for(int line = 0; line <= lines && y + line < 32; line++){
+            uint64_t bits = ((uint64_t)ram[(i + line) & 0x0FFF] << 56) >> x;
+            screen[y + line] = (screen[y + line] & ~mask) | bits;
         }
     }
 
-    void run(){
-        
+    // Returns true when the 60Hz timers ticked, i.e. a new frame began
+    bool run(){
+        bool tick = false;
         if(decrementer <= 0){
             if(dt > 0) {dt--;}
             if(st > 0) {st--;}
-            decrementer = 16;
+            decrementer = instructionsPerFrame;
+            tick = true;
         }
-        updateKeyPresses();
-        runInstruction();
-        drawBuffer();
-        if (pc > 4095) pc = 4095;
-        decrementer = decrementer - 2;
+        if(!skipIdleLoops || !isIdleLoop()){
+            runInstruction();   // a waiting spin loop uses up its slot without executing anything
+            if (pc > 4095) pc = 4095;
+        }
+        decrementer--;
+        return tick;
     }
 
-    void loadBinary(string filename, bool isSaveMode){
-        fstream fin;
-        fin.open(filename, ios::in | ios::binary);
-        if(fin){
-            uint8_t code[4096] = {0x00};
-            if (isSaveMode){
-                fin.read(reinterpret_cast<char*>(code + 0x200),(unsigned long)(getFileSize(filename)* sizeof(uint8_t)));
-            }
-            else {
-                fin.read(reinterpret_cast<char*>(code), (unsigned long)(getFileSize(filename) * sizeof(uint8_t)));
-            }
-            fin.close();
-            loadProgram(code);
+    // For callers that count frames rather than instructions: while the program waits in a spin loop,
+    // uses up the slots left until the next tick at once. Returns the number of slots skipped.
+    int fastForward(){
+        if(!skipIdleLoops || decrementer <= 0 || !isIdleLoop()){
+            return 0;
+        }
+        int skipped = decrementer;
+        decrementer = 0;
+        return skipped;
+    }
+
+    // Copies a program to 0x200. False if it does not fit into RAM.
+    bool loadBuffer(const uint8_t* program, size_t size){
+        if (size > 0x1000 - 0x200){
+            return false;
         }
-        else {
-            exit(1);
+        memcpy(ram + 0x200, program, size);
+        memset(ram + 0x200 + size, 0, 0x1000 - 0x200 - size);
+        return true;
+    }
+};
+
+// Chip8State is cache line aligned, which plain new and std::allocator do not guarantee before C++17.
+// For Chip8 and anything that holds one, e.g. Chip8* cpu = newAligned<Chip8>();
+template <class T> T* newAligned(){
+    void* memory;
+    if(posix_memalign(&memory, alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*), sizeof(T)) != 0){
+        throw bad_alloc();
+    }
+    return new (memory) T();
+}
+
+template <class T> void deleteAligned(T* object){
+    if(object != NULL){
+        object->~T();
+        free(object);
+    }
+}
+
+// Allocator for containers of machine states, e.g. vector<Chip8State, AlignedAllocator<Chip8State> >
+template <class T> class AlignedAllocator {
+    public:
+
+    typedef T value_type;
+
+    AlignedAllocator(){}
+    template <class U> AlignedAllocator(const AlignedAllocator<U>&){}
+
+    T* allocate(size_t count){
+        void* memory;
+        if(posix_memalign(&memory, alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*), count * sizeof(T)) != 0){
+            throw bad_alloc();
         }
+        return (T*)memory;
+    }
+
+    void deallocate(T* memory, size_t){
+        free(memory);
     }
 };
 
+template <class T, class U> bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&){ return true; }
+template <class T, class U> bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&){ return false; }
+
 #endif
\ No newline at end of file
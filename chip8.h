@@ -0,0 +1,85 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+#define CHIP8_ALIGN alignas(64)
+extern "C" {
+#else
+#define CHIP8_ALIGN _Alignas(64)
+#endif
+
+#define CHIP8_API __attribute__((visibility("default")))
+
+// Behaviour the CHIP-8 variants disagree on, see chip8_set_quirks()
+#define QUIRK_SHIFT_VX 0x01     // 8XY6/8XYE shift VX instead of VY
+#define QUIRK_KEEP_I 0x02       // FX55/FX65 leave I unchanged
+#define QUIRK_JUMP_VX 0x04      // BXNN jumps to XNN + VX
+#define QUIRK_WRAP 0x08         // sprites wrap around the screen edges instead of clipping
+
+// Bumped whenever the layout of Chip8State changes. Compare it with chip8_state_version() before reading the state
+// of a library you did not build with this header.
+#define CHIP8_STATE_VERSION 2
+
+// The complete machine state as plain data, so it can be copied with memcpy and packed densely.
+// The registers nearly every instruction touches share the first cache line, RAM and screen follow.
+// unused, decrementer, inputMatrix and seed are interpreter internals, set the keys with chip8_set_keys().
+typedef struct {
+    CHIP8_ALIGN uint8_t v[16]; // V0 to VF are 8-bit general purpose registers. !!! VF must not be used by programs, because it is used for flags !!!
+    uint16_t i; // I is a 16-bit register used for memory addresses. Most often just the twelve lowest bits are used.
+    uint16_t pc; // PC is the 16-bit program counter. it stores the currently executing address.
+    uint8_t sp; // SP is the 8-bit stack pointer and points to the topmost level of the stack.
+    uint8_t dt; // DT is a delay register -> MORE INFORMATION ON DA WAY
+    uint8_t st; // ST is a sound register -> A sound is played, when the register is not zero. In this case it also continiously decremented at a frequency of 60Hz
+    uint8_t unused; // explicit padding, kept zero so states can be compared and hashed bytewise
+    int16_t decrementer; // counts down to the next timer tick
+    uint16_t inputMatrix; // this 16-bit Value shows which keys are active and which not.
+    uint16_t stack[16]; // The stack stores the 16-bit addresses the interpreter should return to when finishing subroutines. CHIP-8 allows for 16 levels of nested subroutines.
+    uint32_t seed; // state of the random generator used by CXNN, so runs are reproducible from the state alone
+    uint8_t ram[4096]; // 0x000 to 0x1FF: Default interpreter space (not usable) -> Start Programs at 0x200 (512 Bytes)
+    uint64_t screen[32]; // This represents a 64x32 monochrome screen, one row per line with the leftmost pixel in the highest bit
+} Chip8State;
+
+// libchip8: the interpreter without any window or keyboard attached.
+// All functions work on machines created by chip8_create(), none of them copy the machine state.
+typedef struct chip8_machine chip8_machine;
+
+CHIP8_API chip8_machine* chip8_create(void);
+CHIP8_API void chip8_destroy(chip8_machine* machine);
+
+// Resets the machine to power-on state and copies a program to 0x200, where execution starts. Instructions per frame
+// and quirks are kept. Returns 0 on success, -1 if it does not fit into RAM, which leaves the machine untouched.
+CHIP8_API int chip8_load(chip8_machine* machine, const uint8_t* program, size_t size);
+
+// Bit n set means keypad key n is held
+CHIP8_API void chip8_set_keys(chip8_machine* machine, uint16_t mask);
+// Values below 1 are taken as 1
+CHIP8_API void chip8_set_instructions_per_frame(chip8_machine* machine, int instructions);
+// QUIRK_* bits, QUIRK_SHIFT_VX | QUIRK_KEEP_I by default
+CHIP8_API void chip8_set_quirks(chip8_machine* machine, uint8_t quirks);
+
+// Executes a number of instructions and returns how many 60Hz frames began meanwhile
+CHIP8_API uint32_t chip8_step(chip8_machine* machine, uint32_t instructions);
+// Executes instructions until the given number of 60Hz frames began
+CHIP8_API void chip8_run_frames(chip8_machine* machine, uint32_t frames);
+// chip8_set_keys() and chip8_run_frames() for many machines in one call. keys may be NULL.
+CHIP8_API void chip8_run_frames_batch(chip8_machine* const* machines, const uint16_t* keys, size_t count, uint32_t frames);
+
+// Writes a record for every instruction the machine executes into a trace file, see trace.cpp and tracequery.
+// Returns 0 on success, -1 if the file cannot be created. chip8_destroy() stops the trace as well.
+CHIP8_API int chip8_trace_start(chip8_machine* machine, const char* path);
+CHIP8_API void chip8_trace_stop(chip8_machine* machine);
+
+// CHIP8_STATE_VERSION of the library
+CHIP8_API uint32_t chip8_state_version(void);
+// Direct access to the live machine state and its 32 screen rows
+CHIP8_API Chip8State* chip8_state(chip8_machine* machine);
+CHIP8_API const uint64_t* chip8_framebuffer(const chip8_machine* machine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,401 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chip8.cpp"
+#include "trace.cpp"
+#include "library.cpp"
+
+#define GOLDEN_HEADER "# chip8 golden v1"
+#define RECENT_INSTRUCTIONS 8   // instructions shown before a divergence
+#define TRAIL_MAGIC 0x4C544843  // "CHTL"
+
+using namespace std;
+
+#define UNCHECKED_PC (1 << 16)  // Checkpoint::unchecked bits 0 to 15 stand for V0 to VF
+#define UNCHECKED_I (1 << 17)
+#define UNCHECKED_SP (1 << 18)
+#define UNCHECKED_DT (1 << 19)
+#define UNCHECKED_ST (1 << 20)
+#define UNCHECKED_SCREEN (1 << 21)
+
+// What gets compared at a checkpoint: the screen as a hash, the registers as they are
+typedef struct {
+    uint64_t count;     // instructions executed so far
+    uint64_t screenHash;
+    uint16_t pc;
+    uint16_t i;
+    uint8_t sp;
+    uint8_t dt;
+    uint8_t st;
+    uint8_t v[16];
+    uint32_t unchecked; // UNCHECKED_* bits of the fields the golden file leaves out with "-"
+} Checkpoint;
+
+Checkpoint capture(Chip8& cpu, uint64_t count){
+    Checkpoint checkpoint;
+    checkpoint.count = count;
+    checkpoint.screenHash = hashWords(cpu.screen, 32);
+    checkpoint.pc = cpu.pc;
+    checkpoint.i = cpu.i;
+    checkpoint.sp = cpu.sp;
+    checkpoint.dt = cpu.dt;
+    checkpoint.st = cpu.st;
+    memcpy(checkpoint.v, cpu.v, 16);
+    checkpoint.unchecked = 0;
+    return checkpoint;
+}
+
+// Hash of the whole machine state, stored after every instruction in the trail file
+uint32_t stateHash(Chip8& cpu){
+    return (uint32_t)hashWords((const uint64_t*)static_cast<Chip8State*>(&cpu), sizeof(Chip8State) / sizeof(uint64_t));
+}
+
+void writeCheckpoint(FILE* file, Checkpoint& checkpoint){
+    fprintf(file, "%llu %016llx %03X %03X %X %02X %02X ", (unsigned long long)checkpoint.count,
+        (unsigned long long)checkpoint.screenHash, checkpoint.pc, checkpoint.i, checkpoint.sp, checkpoint.dt, checkpoint.st);
+    for(int reg = 0; reg < 16; reg++){
+        fprintf(file, "%02X", checkpoint.v[reg]);
+    }
+    fprintf(file, "\n");
+}
+
+// Reads one hexadecimal field, "-" leaves it unchecked
+bool readField(const char* text, uint64_t* value, uint32_t* unchecked, uint32_t bit){
+    if(strcmp(text, "-") == 0 || strcmp(text, "--") == 0){
+        *value = 0;
+        *unchecked |= bit;
+        return true;
+    }
+    char* end;
+    *value = strtoull(text, &end, 16);
+    return end != text && *end == '\0';
+}
+
+bool readCheckpoint(const char* line, Checkpoint& checkpoint){
+    unsigned long long count;
+    char fields[6][24];
+    char registers[33];
+    if(sscanf(line, "%llu %23s %23s %23s %23s %23s %23s %32s", &count, fields[0], fields[1], fields[2], fields[3],
+        fields[4], fields[5], registers) != 8 || strlen(registers) != 32){
+        return false;
+    }
+    const uint32_t bits[6] = {UNCHECKED_SCREEN, UNCHECKED_PC, UNCHECKED_I, UNCHECKED_SP, UNCHECKED_DT, UNCHECKED_ST};
+    uint64_t values[6];
+    checkpoint.unchecked = 0;
+    for(int field = 0; field < 6; field++){
+        if(!readField(fields[field], &values[field], &checkpoint.unchecked, bits[field])){
+            return false;
+        }
+    }
+    checkpoint.count = count;
+    checkpoint.screenHash = values[0];
+    checkpoint.pc = (uint16_t)values[1];
+    checkpoint.i = (uint16_t)values[2];
+    checkpoint.sp = (uint8_t)values[3];
+    checkpoint.dt = (uint8_t)values[4];
+    checkpoint.st = (uint8_t)values[5];
+    for(int reg = 0; reg < 16; reg++){
+        char digits[3] = {registers[reg * 2], registers[reg * 2 + 1], '\0'};
+        uint64_t value;
+        if(!readField(digits, &value, &checkpoint.unchecked, 1 << reg)){
+            return false;
+        }
+        checkpoint.v[reg] = (uint8_t)value;
+    }
+    return true;
+}
+
+string describeDifference(Checkpoint& expected, Checkpoint& actual){
+    char buffer[64];
+    string text;
+    uint32_t checked = ~expected.unchecked;
+    if((checked & UNCHECKED_PC) && expected.pc != actual.pc){ snprintf(buffer, sizeof(buffer), " PC %03X->%03X", expected.pc, actual.pc); text += buffer; }
+    if((checked & UNCHECKED_I) && expected.i != actual.i){ snprintf(buffer, sizeof(buffer), " I %03X->%03X", expected.i, actual.i); text += buffer; }
+    if((checked & UNCHECKED_SP) && expected.sp != actual.sp){ snprintf(buffer, sizeof(buffer), " SP %X->%X", expected.sp, actual.sp); text += buffer; }
+    if((checked & UNCHECKED_DT) && expected.dt != actual.dt){ snprintf(buffer, sizeof(buffer), " DT %02X->%02X", expected.dt, actual.dt); text += buffer; }
+    if((checked & UNCHECKED_ST) && expected.st != actual.st){ snprintf(buffer, sizeof(buffer), " ST %02X->%02X", expected.st, actual.st); text += buffer; }
+    for(int reg = 0; reg < 16; reg++){
+        if((checked & (1 << reg)) && expected.v[reg] != actual.v[reg]){
+            snprintf(buffer, sizeof(buffer), " V%X %02X->%02X", reg, expected.v[reg], actual.v[reg]);
+            text += buffer;
+        }
+    }
+    if((checked & UNCHECKED_SCREEN) && expected.screenHash != actual.screenHash){
+        text += " screen";
+    }
+    return text;
+}
+
+// A ROM being replayed, remembering the instructions it executed last
+class Replay {
+    public:
+
+    Chip8* cpu;
+    uint64_t count;
+    uint16_t recentPc[RECENT_INSTRUCTIONS];
+    uint16_t recentInstruction[RECENT_INSTRUCTIONS];
+    Tracer tracer;
+
+    Replay(){
+        cpu = newAligned<Chip8>();
+        cpu->skipIdleLoops = false;   // every instruction runs, so goldens from other emulators line up
+        count = 0;
+    }
+
+    ~Replay(){
+        tracer.stop();
+        deleteAligned(cpu);
+    }
+
+    void step(){
+        recentPc[count % RECENT_INSTRUCTIONS] = cpu->pc;
+        recentInstruction[count % RECENT_INSTRUCTIONS] = cpu->fetch(cpu->pc);
+        if(tracer.active){
+            tracer.begin(*cpu);
+            cpu->run();
+            tracer.end(*cpu);
+        }
+        else {
+            cpu->run();
+        }
+        count++;
+    }
+
+    string recent(){
+        string text;
+        for(uint64_t recent = count > RECENT_INSTRUCTIONS ? count - RECENT_INSTRUCTIONS : 0; recent < count; recent++){
+            char buffer[16];
+            snprintf(buffer, sizeof(buffer), " %03X:%04X", recentPc[recent % RECENT_INSTRUCTIONS], recentInstruction[recent % RECENT_INSTRUCTIONS]);
+            text += buffer;
+        }
+        return text;
+    }
+};
+
+// Quirks and instructions per frame of every corpus ROM from the ROM library, filled before the workers start
+map<string, RomEntry*> romSettings;
+
+bool loadRom(string filename, Chip8& cpu){
+    map<string, RomEntry*>::iterator settings = romSettings.find(filename);
+    if(settings != romSettings.end()){
+        cpu.quirks = settings->second->quirks;
+        cpu.instructionsPerFrame = settings->second->instructionsPerFrame;
+    }
+    FILE* file = fopen(filename.c_str(), "rb");
+    if(file == NULL){
+        return false;
+    }
+    uint8_t program[0x1000 - 0x200];
+    size_t size = fread(program, 1, sizeof(program), file);
+    fclose(file);
+    return cpu.loadBuffer(program, size);
+}
+
+// Runs a ROM headlessly and writes a checkpoint every `every` instructions, and the state hash after every
+// instruction into the trail file
+string record(string rom, uint64_t instructions, uint64_t every){
+    Replay replay;
+    FILE* file = NULL;
+    FILE* trail = NULL;
+    if(loadRom(rom, *replay.cpu)){
+        file = fopen((rom + ".golden").c_str(), "w");
+        trail = fopen((rom + ".trail").c_str(), "wb");
+    }
+    if(file == NULL || trail == NULL){
+        if(file != NULL) fclose(file);
+        if(trail != NULL) fclose(trail);
+        return "ERROR " + rom;
+    }
+    fprintf(file, "%s\n", GOLDEN_HEADER);
+    uint32_t magic = TRAIL_MAGIC;
+    fwrite(&magic, sizeof(magic), 1, trail);
+    while(replay.count < instructions){
+        replay.step();
+        uint32_t hash = stateHash(*replay.cpu);
+        fwrite(&hash, sizeof(hash), 1, trail);
+        if(replay.count % every == 0){
+            Checkpoint checkpoint = capture(*replay.cpu, replay.count);
+            writeCheckpoint(file, checkpoint);
+        }
+    }
+    fclose(file);
+    fclose(trail);
+    return "RECORDED " + rom;
+}
+
+// Replays a ROM against its trail up to a failing checkpoint. Returns the instruction after which the state
+// first differs, with the instructions executed up to it, or nothing without a usable trail.
+string findDivergence(string rom, uint64_t limit){
+    FILE* trail = fopen((rom + ".trail").c_str(), "rb");
+    if(trail == NULL){
+        return "";
+    }
+    uint32_t magic = 0;
+    vector<uint32_t> hashes(limit);
+    bool usable = fread(&magic, sizeof(magic), 1, trail) == 1 && magic == TRAIL_MAGIC
+        && fread(hashes.data(), sizeof(uint32_t), limit, trail) == limit;
+    fclose(trail);
+    Replay replay;
+    if(!usable || !loadRom(rom, *replay.cpu)){
+        return "";
+    }
+    while(replay.count < limit){
+        replay.step();
+        if(stateHash(*replay.cpu) != hashes[replay.count - 1]){
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "first diverging instruction is #%llu (%03X:%04X)",
+                (unsigned long long)replay.count, replay.recentPc[(replay.count - 1) % RECENT_INSTRUCTIONS],
+                replay.recentInstruction[(replay.count - 1) % RECENT_INSTRUCTIONS]);
+            return string(buffer) + "\n    executed up to it:" + replay.recent();
+        }
+    }
+    return "";
+}
+
+// Replays a ROM against its golden file and describes the first checkpoint that differs.
+// With tracing on, the replay is written to <rom>.trace for tracequery.
+string verify(string rom, bool tracing){
+    FILE* file = fopen((rom + ".golden").c_str(), "r");
+    if(file == NULL){
+        return "SKIP " + rom + ": no golden file";
+    }
+    // A golden file that cannot be read completely fails, so a truncated or damaged one never passes silently
+    vector<Checkpoint> golden;
+    char line[256];
+    string problem;
+    if(fgets(line, sizeof(line), file) == NULL || strncmp(line, GOLDEN_HEADER, strlen(GOLDEN_HEADER)) != 0
+        || strspn(line + strlen(GOLDEN_HEADER), "\r\n") != strlen(line + strlen(GOLDEN_HEADER))){
+        problem = "not a golden file";
+    }
+    for(int number = 2; problem.empty() && fgets(line, sizeof(line), file) != NULL; number++){
+        Checkpoint checkpoint;
+        if(line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)){
+            continue;
+        }
+        if(!readCheckpoint(line, checkpoint)){
+            problem = "unreadable line " + to_string(number);
+        }
+        else if(!golden.empty() && checkpoint.count <= golden.back().count){
+            problem = "instruction counts must increase, line " + to_string(number);
+        }
+        else {
+            golden.push_back(checkpoint);
+        }
+    }
+    fclose(file);
+    if(problem.empty() && golden.empty()){
+        problem = "no checkpoints";
+    }
+    if(!problem.empty()){
+        return "ERROR " + rom + ".golden: " + problem;
+    }
+
+    Replay replay;
+    if(!loadRom(rom, *replay.cpu) || (tracing && !replay.tracer.start(rom + ".trace"))){
+        return "ERROR " + rom;
+    }
+    uint64_t lastMatch = 0;
+    for(size_t ctr = 0; ctr < golden.size(); ctr++){
+        while(replay.count < golden[ctr].count){
+            replay.step();
+        }
+        Checkpoint actual = capture(*replay.cpu, replay.count);
+        string difference = describeDifference(golden[ctr], actual);
+        if(!difference.empty()){
+            string result = "FAIL " + rom + ": diverged after instruction " + to_string(lastMatch) + ", differs at "
+                + to_string(replay.count) + ":" + difference;
+            string exact = findDivergence(rom, replay.count);
+            return result + "\n    " + (exact.empty() ? "last executed:" + replay.recent() : exact);
+        }
+        lastMatch = replay.count;
+    }
+    return "PASS " + rom + " (" + to_string(golden.size()) + " checkpoints)";
+}
+
+int main(int argc, char** argv){
+    bool recording = false;
+    bool tracing = false;
+    uint64_t instructions = 100000;
+    uint64_t every = 100;
+    int threads = (int)thread::hardware_concurrency();
+    vector<string> directories;
+    for(int arg = 1; arg < argc; arg++){
+        if(strcmp(argv[arg], "--record") == 0) recording = true;
+        else if(strcmp(argv[arg], "--trace") == 0) tracing = true;
+        else if(strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) instructions = strtoull(argv[++arg], NULL, 10);
+        else if(strcmp(argv[arg], "-e") == 0 && arg + 1 < argc) every = strtoull(argv[++arg], NULL, 10);
+        else if(strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) threads = atoi(argv[++arg]);
+        else directories.push_back(argv[arg]);
+    }
+    if(directories.empty() || every == 0){
+        printf("usage: %s [--record [-n instructions] [-e checkpoint every n instructions]] [--trace] [-t threads] <corpus directory>...\n", argv[0]);
+        return 1;
+    }
+    if(threads < 1){
+        threads = 1;
+    }
+
+    vector<string> roms;
+    for(size_t dir = 0; dir < directories.size(); dir++){
+        DIR* handle = opendir(directories[dir].c_str());
+        if(handle == NULL){
+            continue;
+        }
+        struct dirent* item;
+        while((item = readdir(handle)) != NULL){
+            string filename = directories[dir] + "/" + item->d_name;
+            struct stat stat_buf;
+            if(isRomFile(item->d_name) && stat(filename.c_str(), &stat_buf) == 0 && !S_ISDIR(stat_buf.st_mode)){
+                roms.push_back(filename);
+            }
+        }
+        closedir(handle);
+    }
+
+    sort(roms.begin(), roms.end());
+    // ROMs that are not indexed yet are probed, but the index is left as it is
+    RomLibrary library(defaultIndexPath());
+    vector<int> indexed(roms.size());
+    for(size_t rom = 0; rom < roms.size(); rom++){
+        indexed[rom] = library.lookup(roms[rom]);
+    }
+    for(size_t rom = 0; rom < roms.size(); rom++){
+        if(indexed[rom] >= 0){
+            romSettings[roms[rom]] = &library.entries[indexed[rom]];
+        }
+    }
+    vector<string> results(roms.size());
+    atomic<size_t> nextRom(0);
+    vector<thread> workers;
+    for(int ctr = 0; ctr < threads; ctr++){
+        workers.push_back(thread([&](){
+            size_t rom;
+            while((rom = nextRom++) < roms.size()){
+                results[rom] = recording ? record(roms[rom], instructions, every) : verify(roms[rom], tracing);
+            }
+        }));
+    }
+    for(size_t ctr = 0; ctr < workers.size(); ctr++){
+        workers[ctr].join();
+    }
+
+    int failed = 0;
+    for(size_t rom = 0; rom < results.size(); rom++){
+        printf("%s\n", results[rom].c_str());
+        if(results[rom].compare(0, 4, "FAIL") == 0 || results[rom].compare(0, 5, "ERROR") == 0){
+            failed++;
+        }
+    }
+    printf("%d of %d ROMs failed\n", failed, (int)results.size());
+    return failed > 0 ? 1 : 0;
+}
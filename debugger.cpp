@@ -0,0 +1,204 @@
+#ifndef DEBUGGER_CPP
+#define DEBUGGER_CPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.cpp"
+
+#define BREAK_PC 0x01       // stop before executing the instruction at this address
+#define WATCH_READ 0x02     // stop before an instruction reads this address
+#define WATCH_WRITE 0x04    // stop before an instruction writes this address
+#define WATCH_I 16          // bit of I in registerWatch, bits 0 to 15 are V0 to VF
+
+using namespace std;
+
+// Breakpoints, watchpoints and stepping on top of Chip8::run(), controlled from stdin.
+// Only used while armed() is true, otherwise the caller runs the plain interpreter loop.
+class Debugger {
+    public:
+
+    uint8_t flags[4096];    // BREAK_PC / WATCH_READ / WATCH_WRITE for every address
+    int flagged;            // addresses with at least one flag set
+    uint32_t registerWatch;
+    bool paused;
+    bool stepping;
+    bool resuming;          // lets the instruction that caused the stop run once it is resumed
+    int returnDepth;        // stack depth to wait for when running to the return, -1 otherwise
+
+    Debugger(){
+        memset(flags, 0, sizeof(flags));
+        flagged = 0;
+        registerWatch = 0;
+        paused = false;
+        stepping = false;
+        resuming = false;
+        returnDepth = -1;
+    }
+
+    bool armed(){
+        return paused || stepping || returnDepth >= 0 || flagged > 0 || registerWatch != 0;
+    }
+
+    void setFlag(uint16_t address, uint8_t flag){
+        address &= 0x0FFF;
+        if(flags[address] == 0){
+            flagged++;
+        }
+        flags[address] |= flag;
+    }
+
+    void clearFlags(uint16_t address){
+        address &= 0x0FFF;
+        if(flags[address] != 0){
+            flagged--;
+        }
+        flags[address] = 0;
+    }
+
+    void printState(Chip8& cpu){
+        printf("PC=%03X [%04X] I=%03X SP=%X DT=%02X ST=%02X\n", cpu.pc, cpu.fetch(cpu.pc), cpu.i, cpu.sp, cpu.dt, cpu.st);
+        for(int reg = 0; reg < 16; reg++){
+            printf("V%X=%02X%s", reg, cpu.v[reg], reg == 15 ? "\n" : " ");
+        }
+    }
+
+    void stop(Chip8& cpu, const char* reason){
+        printf("%s\n", reason);
+        printState(cpu);
+        paused = true;
+        stepping = false;
+        returnDepth = -1;
+    }
+
+    // Reads commands until one of them resumes execution
+    void console(Chip8& cpu){
+        char line[128];
+        while(paused){
+            printf("(chip8) ");
+            fflush(stdout);
+            if(fgets(line, sizeof(line), stdin) == NULL){
+                // No console attached anymore: drop everything and let the program run
+                memset(flags, 0, sizeof(flags));
+                flagged = 0;
+                registerWatch = 0;
+                paused = false;
+                return;
+            }
+            char command = line[0];
+            uint16_t value = (uint16_t)strtol(line + 1, NULL, 16);
+            switch(command){
+                case 'c':
+                    paused = false;
+                    break;
+                case 's':
+                    paused = false;
+                    stepping = true;
+                    break;
+                case 'f':
+                    paused = false;
+                    returnDepth = cpu.sp;
+                    break;
+                case 'b':
+                    setFlag(value, BREAK_PC);
+                    break;
+                case 'r':
+                    setFlag(value, WATCH_READ);
+                    break;
+                case 'w':
+                    setFlag(value, WATCH_WRITE);
+                    break;
+                case 'd':
+                    clearFlags(value);
+                    break;
+                case 'v':
+                    registerWatch ^= 1 << (value & 0x0F);
+                    break;
+                case 'i':
+                    registerWatch ^= 1 << WATCH_I;
+                    break;
+                case 'p':
+                    printState(cpu);
+                    break;
+                case 'm':
+                    for(int ctr = 0; ctr < 16; ctr++){
+                        printf("%02X%s", cpu.ram[(value + ctr) & 0x0FFF], ctr == 15 ? "\n" : " ");
+                    }
+                    break;
+                case 'q':
+                    exit(0);
+                default:
+                    printf("c continue, s step, f run to return, b/r/w <addr> break/watch read/watch write,\n");
+                    printf("d <addr> delete, v <x> watch Vx, i watch I, p registers, m <addr> memory, q quit\n");
+                    break;
+            }
+            if(!paused){
+                resuming = true;
+            }
+        }
+    }
+
+    // Checks the instruction at PC against breakpoints and memory watchpoints before it runs
+    void checkBefore(Chip8& cpu){
+        uint16_t instruction = cpu.fetch(cpu.pc);
+        if(flags[cpu.pc & 0x0FFF] & BREAK_PC){
+            stop(cpu, "Breakpoint");
+            return;
+        }
+        uint16_t address;
+        uint8_t length;
+        bool isWrite;
+        if(flagged > 0 && cpu.memoryAccess(instruction, &address, &length, &isWrite)){
+            for(int ctr = 0; ctr < length; ctr++){
+                if(flags[(address + ctr) & 0x0FFF] & (isWrite ? WATCH_WRITE : WATCH_READ)){
+                    printf("%s of %03X\n", isWrite ? "Write" : "Read", (address + ctr) & 0x0FFF);
+                    stop(cpu, "Watchpoint");
+                    return;
+                }
+            }
+        }
+    }
+
+    // Replaces Chip8::run() while armed
+    bool run(Chip8& cpu){
+        if(!paused && !resuming){
+            checkBefore(cpu);
+        }
+        if(paused){
+            console(cpu);
+        }
+        resuming = false;
+
+        uint8_t v[16];
+        memcpy(v, cpu.v, 16);
+        uint16_t i = cpu.i;
+        uint16_t instruction = cpu.fetch(cpu.pc);
+        // Spin loops are executed while armed, so breakpoints, watches and steps see every instruction
+        bool skipIdleLoops = cpu.skipIdleLoops;
+        cpu.skipIdleLoops = false;
+        bool tick = cpu.run();
+        cpu.skipIdleLoops = skipIdleLoops;
+
+        for(int reg = 0; reg < 16; reg++){
+            if((registerWatch & (1 << reg)) && v[reg] != cpu.v[reg]){
+                printf("V%X: %02X -> %02X\n", reg, v[reg], cpu.v[reg]);
+                stop(cpu, "Register watch");
+            }
+        }
+        if((registerWatch & (1 << WATCH_I)) && i != cpu.i){
+            printf("I: %03X -> %03X\n", i, cpu.i);
+            stop(cpu, "Register watch");
+        }
+        if(returnDepth >= 0 && instruction == 0x00EE && cpu.sp < returnDepth){
+            stop(cpu, "Returned");
+        }
+        if(stepping){
+            stop(cpu, "Step");
+        }
+        return tick;
+    }
+};
+
+#endif
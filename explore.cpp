@@ -0,0 +1,385 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chip8.cpp"
+#include "library.cpp"
+
+#define INPUTS 17               // no key held, then each of the 16 keys alone
+#define CHUNK_STATES 256        // states moved between a worker and the frontier files at once
+#define MAX_FRAME_INSTRUCTIONS 100000
+#define MAX_REPORTS 32
+
+#define CRASH_NONE 0
+#define CRASH_STACK_UNDERFLOW 1
+#define CRASH_STACK_OVERFLOW 2
+#define CRASH_INVALID_INSTRUCTION 3
+#define CRASH_END_OF_MEMORY 4
+
+const char* crashNames[] = {"", "return with empty stack", "call with full stack", "invalid instruction", "ran off the end of memory"};
+
+using namespace std;
+
+// Lock-free set of state hashes in a fixed number of slots, so memory use never grows
+class StateSet {
+    public:
+
+    atomic<uint64_t>* slots;
+    uint64_t mask;
+    uint64_t limit;
+    atomic<uint64_t> used;
+
+    StateSet(uint64_t bytes){
+        uint64_t capacity = 1024;
+        while(capacity * 2 * sizeof(uint64_t) <= bytes){
+            capacity *= 2;
+        }
+        slots = new atomic<uint64_t>[capacity];
+        for(uint64_t ctr = 0; ctr < capacity; ctr++){
+            slots[ctr].store(0, memory_order_relaxed);
+        }
+        mask = capacity - 1;
+        limit = capacity / 10 * 9;
+        used.store(0);
+    }
+
+    ~StateSet(){
+        delete[] slots;
+    }
+
+    // 1 if the hash is new, 0 if it was seen before, -1 if the set is full
+    int insert(uint64_t hash){
+        if(hash == 0){
+            hash = 1;   // 0 marks empty slots
+        }
+        uint64_t index = hash & mask;
+        while(true){
+            uint64_t found = slots[index].load(memory_order_relaxed);
+            if(found == hash){
+                return 0;
+            }
+            if(found == 0){
+                if(used.load(memory_order_relaxed) >= limit){
+                    return -1;
+                }
+                if(slots[index].compare_exchange_strong(found, hash)){
+                    used++;
+                    return 1;
+                }
+                continue;   // someone else took the slot, look at what they stored
+            }
+            index = (index + 1) & mask;
+        }
+    }
+};
+
+// States of one search level, kept in an unlinked temporary file so they never have to fit into memory
+class Frontier {
+    public:
+
+    FILE* file;
+    mutex lock;
+    uint64_t count;
+
+    Frontier(string directory){
+        string name = directory + "/chip8-frontier-XXXXXX";
+        vector<char> path(name.begin(), name.end());
+        path.push_back('\0');
+        int fd = mkstemp(path.data());
+        if(fd < 0){
+            fprintf(stderr, "cannot create a frontier file in %s\n", directory.c_str());
+            exit(1);
+        }
+        unlink(path.data());
+        file = fdopen(fd, "w+b");
+        count = 0;
+    }
+
+    ~Frontier(){
+        fclose(file);
+    }
+
+    void append(const Chip8State* states, size_t number){
+        lock_guard<mutex> guard(lock);
+        if(fwrite(states, sizeof(Chip8State), number, file) != number){
+            fprintf(stderr, "cannot write the frontier, disk full?\n");
+            exit(1);
+        }
+        count += number;
+    }
+
+    void startReading(){
+        fflush(file);
+        rewind(file);
+    }
+
+    size_t take(Chip8State* states, size_t number){
+        lock_guard<mutex> guard(lock);
+        return fread(states, sizeof(Chip8State), number, file);
+    }
+};
+
+class Explorer {
+    public:
+
+    StateSet seen;
+    int instructionsPerFrame;
+    uint8_t quirks;
+    atomic<bool> full;
+    atomic<uint64_t> newStates;
+    mutex reportLock;
+    bool executed[4096];
+    vector<string> crashes;
+    vector<uint16_t> stuck;
+
+    Explorer(uint64_t bytes, int instructions, uint8_t profile) : seen(bytes){
+        instructionsPerFrame = instructions;
+        quirks = profile;
+        full.store(false);
+        newStates.store(0);
+        memset(executed, 0, sizeof(executed));
+    }
+
+    uint64_t hashState(const Chip8State& state){
+        return hashWords((const uint64_t*)&state, sizeof(Chip8State) / sizeof(uint64_t));
+    }
+
+    // Runs up to the next timer tick, checking every instruction before it executes
+    int runFrame(Chip8& cpu, bool* covered){
+        for(int ctr = 0; ctr < MAX_FRAME_INSTRUCTIONS; ctr++){
+            if(ctr > 0 && cpu.decrementer <= 0){
+                return CRASH_NONE;
+            }
+            int loop = cpu.skipIdleLoops ? cpu.idleLoopLength() : 0;
+            if(loop > 0){
+                // a waiting spin loop does not execute, so its whole body is marked here
+                for(int offset = 0; offset < loop; offset++){
+                    covered[(cpu.pc + offset) & 0x0FFF] = true;
+                }
+                if(ctr > 0){
+                    cpu.fastForward();
+                    return CRASH_NONE;
+                }
+            }
+            uint16_t instruction = cpu.fetch(cpu.pc);
+            if(cpu.pc >= 0xFFE){
+                return CRASH_END_OF_MEMORY;
+            }
+            if(instruction == 0x00EE && cpu.sp == 0){
+                return CRASH_STACK_UNDERFLOW;
+            }
+            if((instruction & 0xF000) == 0x2000 && cpu.sp >= 15){
+                return CRASH_STACK_OVERFLOW;
+            }
+            if((instruction & 0xF000) == 0x0000 && instruction != 0x00E0 && instruction != 0x00EE){
+                return CRASH_INVALID_INSTRUCTION;
+            }
+            covered[cpu.pc & 0x0FFF] = true;
+            covered[(cpu.pc + 1) & 0x0FFF] = true;
+            cpu.run();
+        }
+        return CRASH_NONE;
+    }
+
+    void reportCrash(int crash, Chip8& cpu, int depth){
+        char line[128];
+        snprintf(line, sizeof(line), "%s at %03X [%04X]", crashNames[crash], cpu.pc, cpu.fetch(cpu.pc));
+        lock_guard<mutex> guard(reportLock);
+        for(size_t ctr = 0; ctr < crashes.size(); ctr++){
+            if(crashes[ctr].compare(0, strlen(line), line) == 0){
+                return;
+            }
+        }
+        if(crashes.size() < MAX_REPORTS){
+            crashes.push_back(string(line) + ", first after " + to_string(depth) + " frames");
+        }
+    }
+
+    void reportStuck(uint16_t pc){
+        lock_guard<mutex> guard(reportLock);
+        for(size_t ctr = 0; ctr < stuck.size(); ctr++){
+            if(stuck[ctr] == pc){
+                return;
+            }
+        }
+        if(stuck.size() < MAX_REPORTS){
+            stuck.push_back(pc);
+        }
+    }
+
+    // Expands states from current into next until current is used up
+    void worker(Frontier* current, Frontier* next, int depth){
+        Chip8* cpu = newAligned<Chip8>();
+        cpu->instructionsPerFrame = instructionsPerFrame;
+        cpu->quirks = quirks;
+        vector<Chip8State, AlignedAllocator<Chip8State> > input(CHUNK_STATES);
+        vector<Chip8State, AlignedAllocator<Chip8State> > output;
+        output.reserve(CHUNK_STATES);
+        bool covered[4096] = {false};
+        uint64_t found = 0;
+
+        size_t number;
+        while(!full.load(memory_order_relaxed) && (number = current->take(input.data(), CHUNK_STATES)) > 0){
+            for(size_t state = 0; state < number; state++){
+                uint64_t parent = hashState(input[state]);
+                bool changed = false;
+                int key;
+                for(key = 0; key < INPUTS; key++){
+                    memcpy(static_cast<Chip8State*>(cpu), &input[state], sizeof(Chip8State));
+                    cpu->inputMatrix = key == 0 ? 0 : 1 << (key - 1);
+                    int crash = runFrame(*cpu, covered);
+                    cpu->inputMatrix = 0;
+                    if(crash != CRASH_NONE){
+                        reportCrash(crash, *cpu, depth + 1);
+                        changed = true;
+                        continue;
+                    }
+                    uint64_t hash = hashState(*cpu);
+                    changed = changed || hash != parent;
+                    int inserted = seen.insert(hash);
+                    if(inserted < 0){
+                        full.store(true);
+                        break;
+                    }
+                    if(inserted > 0){
+                        found++;
+                        output.push_back(*cpu);
+                        if(output.size() == CHUNK_STATES){
+                            next->append(output.data(), output.size());
+                            output.clear();
+                        }
+                    }
+                }
+                if(!changed && key == INPUTS){   // not when the set filled up before all keys were tried
+                    reportStuck(input[state].pc);
+                }
+            }
+        }
+        next->append(output.data(), output.size());
+        newStates += found;
+
+        lock_guard<mutex> guard(reportLock);
+        for(int address = 0; address < 4096; address++){
+            executed[address] = executed[address] || covered[address];
+        }
+        deleteAligned(cpu);
+    }
+
+    void explore(Chip8& start, int maxDepth, int threads, string spillDirectory){
+        Frontier* current = new Frontier(spillDirectory);
+        start.inputMatrix = 0;
+        seen.insert(hashState(start));
+        current->append(&start, 1);
+        uint64_t total = 1;
+        time_t began = time(NULL);
+
+        int depth = 0;
+        for(; depth < maxDepth && current->count > 0 && !full.load(); depth++){
+            Frontier* next = new Frontier(spillDirectory);
+            current->startReading();
+            newStates.store(0);
+            vector<thread> workers;
+            for(int ctr = 0; ctr < threads; ctr++){
+                workers.push_back(thread(&Explorer::worker, this, current, next, depth));
+            }
+            for(size_t ctr = 0; ctr < workers.size(); ctr++){
+                workers[ctr].join();
+            }
+            total += newStates.load();
+            long seconds = (long)(time(NULL) - began);
+            printf("frame %d: %llu new states, %llu total, %lds\n", depth + 1,
+                (unsigned long long)newStates.load(), (unsigned long long)total, seconds);
+            fflush(stdout);
+            delete current;
+            current = next;
+        }
+        delete current;
+
+        if(full.load()){
+            printf("State set is full, stopped after %d frames. Give it more memory with -m.\n", depth);
+        }
+    }
+
+    void report(uint32_t programSize){
+        printf("\nCrashes:\n");
+        for(size_t ctr = 0; ctr < crashes.size(); ctr++){
+            printf("  %s\n", crashes[ctr].c_str());
+        }
+        printf("States that no input can change (halt loops or softlocks):\n");
+        for(size_t ctr = 0; ctr < stuck.size(); ctr++){
+            printf("  PC=%03X\n", stuck[ctr]);
+        }
+        printf("Program bytes never executed (code or data):\n");
+        uint32_t end = 0x200 + programSize;
+        for(uint32_t address = 0x200; address < end; address++){
+            if(!executed[address]){
+                uint32_t first = address;
+                while(address + 1 < end && !executed[address + 1]){
+                    address++;
+                }
+                printf("  %03X-%03X\n", first, address);
+            }
+        }
+    }
+};
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        printf("usage: %s <rom> [-d frames] [-m megabytes] [-t threads] [-i instructions per frame] [-s spill directory]\n", argv[0]);
+        return 1;
+    }
+    int maxDepth = 600;
+    uint64_t megabytes = 1024;
+    int threads = (int)thread::hardware_concurrency();
+    int instructionsPerFrame = 0;   // from the ROM library unless given
+    string spillDirectory = "/tmp";
+    for(int arg = 2; arg + 1 < argc; arg += 2){
+        if(strcmp(argv[arg], "-d") == 0) maxDepth = atoi(argv[arg + 1]);
+        if(strcmp(argv[arg], "-m") == 0) megabytes = strtoull(argv[arg + 1], NULL, 10);
+        if(strcmp(argv[arg], "-t") == 0) threads = atoi(argv[arg + 1]);
+        if(strcmp(argv[arg], "-i") == 0) instructionsPerFrame = atoi(argv[arg + 1]);
+        if(strcmp(argv[arg], "-s") == 0) spillDirectory = argv[arg + 1];
+    }
+    if(threads < 1){
+        threads = 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if(file == NULL){
+        printf("cannot open %s\n", argv[1]);
+        return 1;
+    }
+    uint8_t program[0x1000 - 0x200];
+    size_t size = fread(program, 1, sizeof(program), file);
+    fclose(file);
+
+    // Quirks and instructions per frame as the ROM library has them. ROMs that are not indexed yet are probed,
+    // but the index is left as it is.
+    Chip8* start = newAligned<Chip8>();
+    RomLibrary library(defaultIndexPath());
+    int rom = library.lookup(argv[1]);
+    if(rom >= 0){
+        start->quirks = library.entries[rom].quirks;
+        if(instructionsPerFrame <= 0){
+            instructionsPerFrame = library.entries[rom].instructionsPerFrame;
+        }
+    }
+    if(instructionsPerFrame <= 0){
+        instructionsPerFrame = 8;
+    }
+    start->instructionsPerFrame = instructionsPerFrame;
+    start->loadBuffer(program, size);
+
+    Explorer* explorer = new Explorer(megabytes * 1024 * 1024, instructionsPerFrame, start->quirks);
+    explorer->explore(*start, maxDepth, threads, spillDirectory);
+    explorer->report((uint32_t)size);
+    return 0;
+}
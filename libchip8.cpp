@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+
+#include "chip8.h"
+#include "chip8.cpp"
+#include "trace.cpp"
+
+struct chip8_machine {
+    Chip8 cpu;
+    Tracer tracer;
+};
+
+chip8_machine* chip8_create(void){
+    try{
+        return newAligned<chip8_machine>();
+    }catch(const bad_alloc&){
+        return NULL;
+    }
+}
+
+void chip8_destroy(chip8_machine* machine){
+    if(machine != NULL){
+        machine->tracer.stop();
+        deleteAligned(machine);
+    }
+}
+
+int chip8_load(chip8_machine* machine, const uint8_t* program, size_t size){
+    Chip8& cpu = machine->cpu;
+    if(size > 0x1000 - 0x200){
+        return -1;
+    }
+    cpu.reset();
+    cpu.pc = 0x200;
+    return cpu.loadBuffer(program, size) ? 0 : -1;
+}
+
+void chip8_set_keys(chip8_machine* machine, uint16_t mask){
+    machine->cpu.inputMatrix = mask;
+}
+
+void chip8_set_instructions_per_frame(chip8_machine* machine, int instructions){
+    machine->cpu.instructionsPerFrame = instructions > 0 ? instructions : 1;
+}
+
+void chip8_set_quirks(chip8_machine* machine, uint8_t quirks){
+    machine->cpu.quirks = quirks;
+}
+
+int chip8_trace_start(chip8_machine* machine, const char* path){
+    machine->tracer.stop();
+    return machine->tracer.start(path) ? 0 : -1;
+}
+
+void chip8_trace_stop(chip8_machine* machine){
+    machine->tracer.stop();
+}
+
+// The stepping loops are only replaced while a trace is written, so untraced machines pay nothing for it
+static uint32_t traceStep(chip8_machine* machine, uint32_t instructions){
+    Chip8& cpu = machine->cpu;
+    Tracer& tracer = machine->tracer;
+    uint32_t frames = 0;
+    while(instructions > 0 && tracer.active){
+        tracer.begin(cpu);
+        frames += cpu.run();
+        tracer.end(cpu);
+        instructions--;
+    }
+    while(instructions > 0){
+        frames += cpu.run();    // the trace file could not be written any more
+        instructions--;
+    }
+    return frames;
+}
+
+uint32_t chip8_step(chip8_machine* machine, uint32_t instructions){
+    if(machine->tracer.active){
+        return traceStep(machine, instructions);
+    }
+    Chip8& cpu = machine->cpu;
+    uint32_t frames = 0;
+    while(instructions > 0){
+        frames += cpu.run();
+        instructions--;
+    }
+    return frames;
+}
+
+void chip8_run_frames(chip8_machine* machine, uint32_t frames){
+    Chip8& cpu = machine->cpu;
+    if(machine->tracer.active){
+        while(frames > 0){
+            frames -= traceStep(machine, 1);
+        }
+        return;
+    }
+    while(frames > 0){
+        cpu.fastForward();
+        frames -= cpu.run();
+    }
+}
+
+void chip8_run_frames_batch(chip8_machine* const* machines, const uint16_t* keys, size_t count, uint32_t frames){
+    for(size_t ctr = 0; ctr < count; ctr++){
+        if(keys != NULL){
+            machines[ctr]->cpu.inputMatrix = keys[ctr];
+        }
+        chip8_run_frames(machines[ctr], frames);
+    }
+}
+
+uint32_t chip8_state_version(void){
+    return CHIP8_STATE_VERSION;
+}
+
+Chip8State* chip8_state(chip8_machine* machine){
+    return &machine->cpu;
+}
+
+const uint64_t* chip8_framebuffer(const chip8_machine* machine){
+    return machine->cpu.screen;
+}
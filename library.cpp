@@ -0,0 +1,268 @@
+#ifndef LIBRARY_CPP
+#define LIBRARY_CPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "chip8.cpp"
+
+#define INDEX_MAGIC 0x58493843  // "C8IX"
+#define INDEX_VERSION 3
+#define MAX_ROM_SIZE (4096 - 0x200)
+
+#define PLATFORM_CHIP8 0
+#define PLATFORM_SCHIP 1
+#define PLATFORM_XOCHIP 2
+
+using namespace std;
+
+// Everything remembered about one ROM. Fixed size, so the index is read and written in one go.
+typedef struct {
+    uint64_t hash;          // FNV-1a of the file contents
+    int64_t modified;       // modification time when the file was indexed
+    uint32_t size;
+    uint8_t platform;
+    uint8_t quirks;         // QUIRK_* switches for Chip8::quirks
+    uint16_t instructionsPerFrame;
+    char keyMap[16];        // host key per keypad key, all zero for the front end's default
+    char path[256];
+    uint8_t image[4096];    // RAM image with the program at 0x200, ready for loadProgram()
+} RomEntry;
+
+uint64_t hashContents(const uint8_t* data, size_t length){
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for(size_t ctr = 0; ctr < length; ctr++){
+        hash = (hash ^ data[ctr]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+string defaultIndexPath(){
+    const char* home = getenv("HOME");
+    return string(home != NULL ? home : ".") + "/.chip8index";
+}
+
+bool isRomFile(string filename){
+    const char* extensions[] = {".ch8", ".c8", ".sc8", ".xo8"};
+    for(int ctr = 0; ctr < 4; ctr++){
+        size_t length = strlen(extensions[ctr]);
+        if(filename.size() > length && filename.compare(filename.size() - length, length, extensions[ctr]) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+// Persistent index of ROMs. Settings are shared by content hash, files whose size and modification time did not
+// change since they were indexed are served from the index without being read again.
+class RomLibrary {
+    public:
+
+    string indexPath;
+    vector<RomEntry> entries;
+    bool changed;
+
+    RomLibrary(string path){
+        indexPath = path;
+        changed = false;
+        load();
+    }
+
+    void load(){
+        FILE* file = fopen(indexPath.c_str(), "rb");
+        if(file == NULL){
+            return;
+        }
+        // A damaged or foreign index is treated as empty, it gets rebuilt on the next save
+        struct stat stat_buf;
+        uint32_t header[3];
+        if(fstat(fileno(file), &stat_buf) == 0 && fread(header, sizeof(header), 1, file) == 1
+            && header[0] == INDEX_MAGIC && header[1] == INDEX_VERSION
+            && header[2] == (stat_buf.st_size - sizeof(header)) / sizeof(RomEntry)){
+            entries.resize(header[2]);
+            if(fread(entries.data(), sizeof(RomEntry), header[2], file) != header[2]){
+                entries.clear();
+            }
+        }
+        fclose(file);
+    }
+
+    bool save(){
+        if(!changed){
+            return true;
+        }
+        FILE* file = fopen(indexPath.c_str(), "wb");
+        if(file == NULL){
+            return false;
+        }
+        uint32_t header[3] = {INDEX_MAGIC, INDEX_VERSION, (uint32_t)entries.size()};
+        bool ok = fwrite(header, sizeof(header), 1, file) == 1
+            && fwrite(entries.data(), sizeof(RomEntry), entries.size(), file) == entries.size();
+        fclose(file);
+        changed = !ok;
+        return ok;
+    }
+
+    int findHash(uint64_t hash){
+        for(size_t ctr = 0; ctr < entries.size(); ctr++){
+            if(entries[ctr].hash == hash){
+                return (int)ctr;
+            }
+        }
+        return -1;
+    }
+
+    int findPath(string filename){
+        for(size_t ctr = 0; ctr < entries.size(); ctr++){
+            if(filename == entries[ctr].path){
+                return (int)ctr;
+            }
+        }
+        return -1;
+    }
+
+    // Looks for instructions that only exist on the later CHIP-8 variants. Only instructions reachable from 0x200
+    // are looked at, since sprite rows like F0 00 or 00 FF would otherwise read as such instructions.
+    void probe(RomEntry& entry){
+        entry.platform = PLATFORM_CHIP8;
+        uint32_t end = 0x200 + entry.size;
+        bool visited[4096] = {false};
+        vector<uint16_t> pending(1, 0x200);
+        while(!pending.empty()){
+            uint16_t address = pending.back();
+            pending.pop_back();
+            if((uint32_t)address + 1 >= end || visited[address]){
+                continue;
+            }
+            visited[address] = true;
+            uint16_t instruction = ((uint16_t)entry.image[address] << 8) | entry.image[address + 1];
+            if(instruction == 0xF000 || (instruction & 0xF00F) == 0x5002 || (instruction & 0xF00F) == 0x5003
+                || (instruction & 0xF0FF) == 0xF001 || instruction == 0xF002 || (instruction & 0xFFF0) == 0x00D0){
+                entry.platform = PLATFORM_XOCHIP;
+                break;
+            }
+            if((instruction >= 0x00FB && instruction <= 0x00FF) || (instruction & 0xFFF0) == 0x00C0
+                || (instruction & 0xF0FF) == 0xF030 || (instruction & 0xF0FF) == 0xF075 || (instruction & 0xF0FF) == 0xF085){
+                entry.platform = PLATFORM_SCHIP;
+            }
+
+            uint8_t kind = instruction >> 12;
+            uint8_t lastByte = instruction & 0x00FF;
+            if(kind == 0x1){
+                pending.push_back(instruction & 0x0FFF);
+            }
+            else if(kind == 0x2){
+                pending.push_back(instruction & 0x0FFF);
+                pending.push_back(address + 2);
+            }
+            else if(kind == 0x3 || kind == 0x4 || kind == 0x5 || kind == 0x9 || (kind == 0xE && (lastByte == 0x9E || lastByte == 0xA1))){
+                pending.push_back(address + 2);
+                pending.push_back(address + 4);
+            }
+            else if(instruction != 0x00EE && instruction != 0x00FD && kind != 0xB){
+                pending.push_back(address + 2);     // returns, exit and computed jumps end the path
+            }
+        }
+        switch(entry.platform){
+            // Instructions per frame for loops that run whole frames; the GLUT front end runs one slot per display call
+            case PLATFORM_SCHIP:
+                entry.quirks = QUIRK_SHIFT_VX | QUIRK_KEEP_I | QUIRK_JUMP_VX;
+                entry.instructionsPerFrame = 30;
+                break;
+            case PLATFORM_XOCHIP:
+                entry.quirks = QUIRK_WRAP;
+                entry.instructionsPerFrame = 1000;
+                break;
+            default:
+                entry.quirks = QUIRK_SHIFT_VX | QUIRK_KEEP_I;   // what this interpreter always did
+                entry.instructionsPerFrame = 8;
+                break;
+        }
+    }
+
+    // Returns the index entry for a ROM file, probing and adding it if it is new. -1 if unreadable.
+    int lookup(string filename){
+        char resolved[PATH_MAX];
+        if(realpath(filename.c_str(), resolved) == NULL){
+            return -1;
+        }
+        filename = resolved;
+        struct stat stat_buf;
+        if(stat(filename.c_str(), &stat_buf) != 0 || stat_buf.st_size > MAX_ROM_SIZE || filename.size() >= 256){
+            return -1;
+        }
+        int known = findPath(filename);
+        if(known >= 0 && entries[known].modified == (int64_t)stat_buf.st_mtime && entries[known].size == (uint32_t)stat_buf.st_size){
+            return known;
+        }
+
+        RomEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        FILE* file = fopen(filename.c_str(), "rb");
+        if(file == NULL){
+            return -1;
+        }
+        entry.size = (uint32_t)fread(entry.image + 0x200, 1, MAX_ROM_SIZE, file);
+        fclose(file);
+        entry.hash = hashContents(entry.image + 0x200, entry.size);
+        entry.modified = (int64_t)stat_buf.st_mtime;
+        strcpy(entry.path, filename.c_str());
+
+        // Same contents seen before under another name: reuse its settings instead of probing again
+        int same = findHash(entry.hash);
+        if(same >= 0){
+            entry.platform = entries[same].platform;
+            entry.quirks = entries[same].quirks;
+            entry.instructionsPerFrame = entries[same].instructionsPerFrame;
+            memcpy(entry.keyMap, entries[same].keyMap, 16);
+        }
+        else {
+            probe(entry);
+        }
+        if(known >= 0){
+            entries[known] = entry;
+        }
+        else {
+            entries.push_back(entry);
+            known = (int)entries.size() - 1;
+        }
+        changed = true;
+        return known;
+    }
+
+    // Indexes every ROM below a directory
+    void scan(string directory){
+        DIR* dir = opendir(directory.c_str());
+        if(dir == NULL){
+            return;
+        }
+        struct dirent* item;
+        while((item = readdir(dir)) != NULL){
+            string name = item->d_name;
+            if(name == "." || name == ".."){
+                continue;
+            }
+            string filename = directory + "/" + name;
+            struct stat stat_buf;
+            if(stat(filename.c_str(), &stat_buf) != 0){
+                continue;
+            }
+            if(S_ISDIR(stat_buf.st_mode)){
+                scan(filename);
+            }
+            else if(isRomFile(name)){
+                lookup(filename);
+            }
+        }
+        closedir(dir);
+    }
+};
+
+#endif
@@ -1,21 +1,86 @@
 #include <stdlib.h>
 #include <stdint.h>
+#include <errno.h>
 
 #include "chip8.cpp"
+#include "inputs.cpp"
+#include "rewind.cpp"
+#include "library.cpp"
+#include "debugger.cpp"
+#include "recorder.cpp"
+#include "trace.cpp"
 
 #define PIXEL_SIZE 10       //the x/y length/height of every pixel on the screen
+#define REWIND_MEMORY (16 * 1024 * 1024)    //upper bound for the rewind history in bytes
+#define KEYFRAME_INTERVAL 60        //frames between two full snapshots in the rewind history
+#define REWIND_DELAY 8      //display calls per rewound frame, the same pace as the timer ticks
 #define GL_SILENCE_DEPRECATION      //used for silencing some compiler warnings
 
 using namespace std;
 
-Chip8 cpu = Chip8(&keys);
+Chip8 cpu;
+Rewind history(REWIND_MEMORY, KEYFRAME_INTERVAL);
+Debugger debugger;
+Recorder recorder;
+Tracer tracer;
+int rewindDelay = 0;
+
+void drawPixel(int x, int y, int isOn){
+    if(isOn > 0){
+        glColor3f(1, 1, 1);
+    }
+    else {
+        glColor3f(0, 0, 0);
+    }
+    glBegin(GL_QUADS);
+    glVertex2i(PIXEL_SIZE * x, PIXEL_SIZE * y);
+    glVertex2i(PIXEL_SIZE * x, PIXEL_SIZE * (y + 1));
+    glVertex2i(PIXEL_SIZE * (x + 1), PIXEL_SIZE * (y + 1));
+    glVertex2i(PIXEL_SIZE * (x + 1), PIXEL_SIZE * y);
+    glEnd();
+}
+
+void drawBuffer(){
+    for(int x = 0; x < 64; x++){
+        for(int y = 0; y < 32; y++){
+            if(cpu.pixel(x, y)){
+                drawPixel(x, y, 1);
+            }
+        }
+    }
+}
 
 void display(){
     //auto start = high_resolution_clock::now();
     glutPostRedisplay();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    cpu.run();
-    
+    cpu.inputMatrix = keypadMask();
+    if(keys.down['p']){
+        debugger.paused = true;
+    }
+    if(keys.down['b']){
+        rewindDelay--;
+        if(rewindDelay <= 0){
+            history.stepBack(cpu);
+            recorder.push(cpu.screen);
+            rewindDelay = REWIND_DELAY;
+        }
+    }
+    else {
+        if(tracer.active){
+            tracer.begin(cpu);
+        }
+        bool tick = debugger.armed() ? debugger.run(cpu) : cpu.run();
+        if(tracer.active){
+            tracer.end(cpu);
+        }
+        if(tick){
+            history.record(cpu);
+            recorder.push(cpu.screen);
+        }
+    }
+    drawBuffer();
+
     glutSwapBuffers();
 }
 
@@ -36,8 +101,81 @@ void setupOpenGL(){
     glutKeyboardUpFunc(buttonUp);
 }
 
+void stopCapture(){
+    recorder.stop();
+    tracer.stop();
+}
+
+// ROMs the library cannot index, e.g. because of a very long path, still run with the default settings
+bool loadUnindexed(string filename){
+    FILE* file = fopen(filename.c_str(), "rb");
+    if(file == NULL){
+        fprintf(stderr, "cannot open %s: %s\n", filename.c_str(), strerror(errno));
+        return false;
+    }
+    uint8_t program[MAX_ROM_SIZE + 1];
+    size_t size = fread(program, 1, sizeof(program), file);
+    fclose(file);
+    if(!cpu.loadBuffer(program, size)){
+        fprintf(stderr, "%s does not fit into RAM, programs can have at most %d bytes\n", filename.c_str(), MAX_ROM_SIZE);
+        return false;
+    }
+    return true;
+}
+
 int main(int argc, char** argv){
-    cpu.loadBinary(argv[1], true);
+    if(argc < 2){
+        printf("usage: %s [--debug] [--record <file.gif>] [--trace <file>] <rom> | --scan <directory>...\n", argv[0]);
+        return 1;
+    }
+    RomLibrary library(defaultIndexPath());
+    if(string(argv[1]) == "--scan"){
+        for(int arg = 2; arg < argc; arg++){
+            library.scan(argv[arg]);
+        }
+        library.save();
+        printf("%d ROMs indexed\n", (int)library.entries.size());
+        return 0;
+    }
+
+    int arg = 1;
+    while(arg < argc - 1){
+        if(string(argv[arg]) == "--debug"){
+            debugger.paused = true;
+            arg++;
+        }
+        else if(string(argv[arg]) == "--record" && arg < argc - 2){
+            if(!recorder.start(argv[arg + 1])){
+                exit(1);
+            }
+            arg += 2;
+        }
+        else if(string(argv[arg]) == "--trace" && arg < argc - 2){
+            if(!tracer.start(argv[arg + 1])){
+                exit(1);
+            }
+            arg += 2;
+        }
+        else {
+            break;
+        }
+    }
+    atexit(stopCapture);
+    int rom = library.lookup(argv[arg]);
+    if(rom >= 0){
+        library.save();
+        RomEntry& entry = library.entries[rom];
+        cpu.loadProgram(entry.image);
+        // entry.instructionsPerFrame is not used: the display loop runs one slot per call, not whole frames,
+        // so a larger value would only make the timers tick less often
+        cpu.quirks = entry.quirks;
+        if(entry.keyMap[0] != 0){
+            memcpy(keys.keyMap, entry.keyMap, 16);
+        }
+    }
+    else if(!loadUnindexed(argv[arg])){
+        exit(1);
+    }
     glutInit(&argc, argv);
     setupOpenGL();
     glutMainLoop();
@@ -0,0 +1,307 @@
+#ifndef RECORDER_CPP
+#define RECORDER_CPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#define QUEUE_FRAMES 256    // frames the emulation can run ahead of the encoder
+#define GIF_SCALE 4         // size of one CHIP-8 pixel in the GIF
+#define GIF_WIDTH (64 * GIF_SCALE)
+#define GIF_HEIGHT (32 * GIF_SCALE)
+#define LZW_MIN_CODE_SIZE 2 // the smallest GIF allows, enough for a 2 color palette
+#define MIN_GIF_DELAY 2     // centiseconds, browsers show shorter frames for about 10
+
+using namespace std;
+
+// Packs LZW codes LSB first into GIF data sub-blocks
+class GifBlockWriter {
+    public:
+
+    FILE* file;
+    uint8_t block[255];
+    int blockSize;
+    uint32_t bits;
+    int bitCount;
+
+    GifBlockWriter(FILE* output){
+        file = output;
+        blockSize = 0;
+        bits = 0;
+        bitCount = 0;
+    }
+
+    void writeCode(uint32_t code, int size){
+        bits |= code << bitCount;
+        bitCount += size;
+        while(bitCount >= 8){
+            writeByte(bits & 0xFF);
+            bits >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    void writeByte(uint8_t value){
+        block[blockSize++] = value;
+        if(blockSize == 255){
+            flushBlock();
+        }
+    }
+
+    void flushBlock(){
+        if(blockSize > 0){
+            fputc(blockSize, file);
+            fwrite(block, 1, blockSize, file);
+            blockSize = 0;
+        }
+    }
+
+    void finish(){
+        if(bitCount > 0){
+            writeByte(bits & 0xFF);
+            bits = 0;
+            bitCount = 0;
+        }
+        flushBlock();
+        fputc(0, file);
+    }
+};
+
+// Records presented frames into an animated GIF. The emulation thread only copies each frame into
+// a lock-free single producer/single consumer queue, a background thread compresses and writes them.
+class Recorder {
+    public:
+
+    FILE* file;
+    uint64_t queue[QUEUE_FRAMES][32];
+    atomic<uint32_t> writeIndex;
+    atomic<uint32_t> readIndex;
+    atomic<bool> stopping;
+    atomic<uint32_t> dropped;
+    thread encoder;
+    bool active;
+
+    uint64_t shown[32];         // the frame the GIF currently shows
+    uint64_t pending[32];       // frame waiting for its display time to be known
+    uint32_t pendingFrames;     // 60Hz frames the pending frame stays on screen
+    bool hasPending;
+    bool hasShown;
+    uint64_t totalFrames;       // 60Hz frames written so far
+    uint64_t totalCentiseconds; // GIF delay written so far
+    uint16_t lzwChildren[4096][2];
+
+    Recorder(){
+        file = NULL;
+        active = false;
+    }
+
+    bool start(string filename){
+        file = fopen(filename.c_str(), "wb");
+        if(file == NULL){
+            return false;
+        }
+        writeIndex.store(0);
+        readIndex.store(0);
+        stopping.store(false);
+        dropped.store(0);
+        hasPending = false;
+        hasShown = false;
+        totalFrames = 0;
+        totalCentiseconds = 0;
+        writeHeader();
+        encoder = thread(&Recorder::encode, this);
+        active = true;
+        return true;
+    }
+
+    // Called by the emulation once per presented frame, never blocks
+    void push(const uint64_t* screen){
+        if(!active){
+            return;
+        }
+        uint32_t head = writeIndex.load(memory_order_relaxed);
+        if(head - readIndex.load(memory_order_acquire) == QUEUE_FRAMES){
+            dropped++;
+            return;
+        }
+        memcpy(queue[head % QUEUE_FRAMES], screen, sizeof(queue[0]));
+        writeIndex.store(head + 1, memory_order_release);
+    }
+
+    void stop(){
+        if(!active){
+            return;
+        }
+        stopping.store(true);
+        encoder.join();
+        if(hasPending){
+            writeFrame();
+        }
+        fputc(0x3B, file);  // trailer
+        fclose(file);
+        active = false;
+        if(dropped.load() > 0){
+            fprintf(stderr, "Recorder: %u frames dropped\n", dropped.load());
+        }
+    }
+
+    void writeShort(uint16_t value){
+        fputc(value & 0xFF, file);
+        fputc(value >> 8, file);
+    }
+
+    void writeHeader(){
+        fwrite("GIF89a", 1, 6, file);
+        writeShort(GIF_WIDTH);
+        writeShort(GIF_HEIGHT);
+        fputc(0x80, file);  // global color table with 2 entries
+        fputc(0, file);     // background color
+        fputc(0, file);     // pixel aspect ratio
+        const uint8_t palette[6] = {0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF};
+        fwrite(palette, 1, 6, file);
+        // Loop forever
+        const uint8_t loop[19] = {0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00};
+        fwrite(loop, 1, 19, file);
+    }
+
+    bool pixel(const uint64_t* screen, int x, int y){
+        return (screen[y / GIF_SCALE] >> (63 - x / GIF_SCALE)) & 1;
+    }
+
+    // GIF delay the pending frame would get now, the rounding error is carried over to the next frame
+    uint64_t pendingDelay(){
+        return (totalFrames + pendingFrames) * 100 / 60 - totalCentiseconds;
+    }
+
+    // Writes the pending frame, limited to the area that changed since the last written one
+    void writeFrame(){
+        int left = 0, top = 0, right = 63, bottom = 31;
+        if(hasShown){
+            top = 32;
+            bottom = -1;
+            uint64_t columns = 0;
+            for(int row = 0; row < 32; row++){
+                uint64_t changed = shown[row] ^ pending[row];
+                if(changed != 0){
+                    top = top < row ? top : row;
+                    bottom = row;
+                    columns |= changed;
+                }
+            }
+            if(bottom < 0){
+                top = bottom = 0;   // nothing changed, a 1x1 frame just carries the delay
+                columns = 1ull << 63;
+            }
+            left = __builtin_clzll(columns);
+            right = 63 - __builtin_ctzll(columns);
+        }
+
+        totalFrames += pendingFrames;
+        uint64_t centiseconds = totalFrames * 100 / 60;
+        uint16_t delay = (uint16_t)(centiseconds - totalCentiseconds);
+        totalCentiseconds = centiseconds;
+
+        const uint8_t control[4] = {0x21, 0xF9, 0x04, 0x04};  // graphic control, keep the previous frame below
+        fwrite(control, 1, 4, file);
+        writeShort(delay);
+        fputc(0, file);
+        fputc(0, file);
+
+        int x = left * GIF_SCALE, y = top * GIF_SCALE;
+        int width = (right - left + 1) * GIF_SCALE, height = (bottom - top + 1) * GIF_SCALE;
+        fputc(0x2C, file);
+        writeShort(x);
+        writeShort(y);
+        writeShort(width);
+        writeShort(height);
+        fputc(0, file);
+        writeImage(x, y, width, height);
+
+        memcpy(shown, pending, sizeof(shown));
+        hasShown = true;
+    }
+
+    // LZW compression of the pending frame's pixels inside the given rectangle
+    void writeImage(int left, int top, int width, int height){
+        const uint32_t clearCode = 1 << LZW_MIN_CODE_SIZE;
+        fputc(LZW_MIN_CODE_SIZE, file);
+        GifBlockWriter writer(file);
+        int codeSize = LZW_MIN_CODE_SIZE + 1;
+        uint32_t maxCode = clearCode + 1;
+        memset(lzwChildren, 0, sizeof(lzwChildren));
+        writer.writeCode(clearCode, codeSize);
+
+        int32_t current = -1;
+        for(int y = top; y < top + height; y++){
+            for(int x = left; x < left + width; x++){
+                uint8_t value = pixel(pending, x, y);
+                if(current < 0){
+                    current = value;
+                }
+                else if(lzwChildren[current][value] != 0){
+                    current = lzwChildren[current][value];
+                }
+                else {
+                    writer.writeCode(current, codeSize);
+                    lzwChildren[current][value] = ++maxCode;
+                    if(maxCode >= (1u << codeSize)){
+                        codeSize++;
+                    }
+                    if(maxCode == 4095){
+                        writer.writeCode(clearCode, codeSize);
+                        memset(lzwChildren, 0, sizeof(lzwChildren));
+                        codeSize = LZW_MIN_CODE_SIZE + 1;
+                        maxCode = clearCode + 1;
+                    }
+                    current = value;
+                }
+            }
+        }
+        writer.writeCode(current, codeSize);
+        // Decoders add one more table entry after reading the last code, which can widen the codes that follow
+        if(++maxCode >= (1u << codeSize) && codeSize < 12){
+            codeSize++;
+        }
+        writer.writeCode(clearCode, codeSize);
+        writer.writeCode(clearCode + 1, LZW_MIN_CODE_SIZE + 1);
+        writer.finish();
+    }
+
+    // Encoder thread: repeated frames only extend the display time of the previous one
+    void encode(){
+        while(true){
+            uint32_t tail = readIndex.load(memory_order_relaxed);
+            if(tail == writeIndex.load(memory_order_acquire)){
+                if(stopping.load()){
+                    return;
+                }
+                this_thread::sleep_for(chrono::milliseconds(1));
+                continue;
+            }
+            const uint64_t* frame = queue[tail % QUEUE_FRAMES];
+            if(hasPending && memcmp(frame, pending, sizeof(pending)) == 0){
+                pendingFrames++;
+            }
+            else {
+                if(hasPending && pendingDelay() >= MIN_GIF_DELAY){
+                    writeFrame();
+                    hasPending = false;
+                }
+                // A frame too short for GIF players is replaced by the next one, which takes over its time
+                if(!hasPending){
+                    pendingFrames = 0;
+                }
+                memcpy(pending, frame, sizeof(pending));
+                pendingFrames++;
+                hasPending = true;
+            }
+            readIndex.store(tail + 1, memory_order_release);
+        }
+    }
+};
+
+#endif
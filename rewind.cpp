@@ -0,0 +1,239 @@
+#ifndef REWIND_CPP
+#define REWIND_CPP
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.cpp"
+
+#define REWIND_STATE_SIZE sizeof(Chip8State)
+#define REWIND_BYTES_PER_FRAME 256  // expected average record size, used to size the frame table
+
+using namespace std;
+
+typedef struct {
+    uint32_t offset;    // start of the record in the arena
+    uint32_t length;    // size of the record in bytes
+    bool isKeyframe;    // full snapshot instead of a delta against the previous frame
+} RewindFrame;
+
+// Bounded history of past frames. Every keyframeInterval frames a full snapshot is stored,
+// every other frame only keeps the bytes that changed (XORed against the previous frame).
+// All memory is allocated once in the constructor, the oldest frames get dropped when it runs out.
+class Rewind {
+    public:
+
+    uint8_t* arena;         // ring buffer holding the records
+    uint32_t arenaSize;
+    uint32_t writePos;      // end of the newest record
+    RewindFrame* frames;    // ring of record descriptors, oldest at frames[first]
+    int maxFrames;
+    int first;
+    int count;
+    int keyframeInterval;
+    int sinceKeyframe;      // deltas stored since the newest keyframe
+    uint8_t current[REWIND_STATE_SIZE];    // state of the newest frame
+    uint8_t next[REWIND_STATE_SIZE];       // state being recorded
+    uint8_t delta[REWIND_STATE_SIZE];      // encoded delta of next against current
+    uint32_t deltaLength;
+
+    Rewind(uint32_t memoryCap, int interval){
+        maxFrames = memoryCap / REWIND_BYTES_PER_FRAME;
+        frames = (RewindFrame*)malloc(maxFrames * sizeof(RewindFrame));
+        arenaSize = memoryCap - maxFrames * sizeof(RewindFrame);
+        arena = (uint8_t*)malloc(arenaSize);
+        keyframeInterval = interval;
+        clear();
+    }
+
+    ~Rewind(){
+        free(frames);
+        free(arena);
+    }
+
+    void clear(){
+        first = 0;
+        count = 0;
+        writePos = 0;
+        sinceKeyframe = 0;
+    }
+
+    void saveState(Chip8& cpu, uint8_t* out){
+        memcpy(out, static_cast<Chip8State*>(&cpu), sizeof(Chip8State));
+    }
+
+    void loadState(Chip8& cpu, const uint8_t* in){
+        memcpy(static_cast<Chip8State*>(&cpu), in, sizeof(Chip8State));
+    }
+
+    // Encodes next against current as runs of [skip, length, XORed bytes].
+    // Returns false if the delta would not be smaller than a keyframe.
+    bool encodeDelta(){
+        uint32_t pos = 0;
+        uint32_t last = 0;
+        deltaLength = 0;
+        while(pos < REWIND_STATE_SIZE){
+            if(next[pos] == current[pos]){
+                pos++;
+                continue;
+            }
+            // Unchanged gaps shorter than a run header are cheaper to store inside the run
+            uint32_t end = pos + 1;
+            uint32_t look = end;
+            while(look < REWIND_STATE_SIZE && look < end + 4){
+                if(next[look] != current[look]){
+                    end = look + 1;
+                }
+                look++;
+            }
+            uint32_t length = end - pos;
+            if(deltaLength + 4 + length >= REWIND_STATE_SIZE){
+                return false;
+            }
+            uint16_t skip = (uint16_t)(pos - last);
+            uint16_t runLength = (uint16_t)length;
+            memcpy(delta + deltaLength, &skip, 2);
+            memcpy(delta + deltaLength + 2, &runLength, 2);
+            deltaLength += 4;
+            for(uint32_t ctr = pos; ctr < end; ctr++){
+                delta[deltaLength++] = next[ctr] ^ current[ctr];
+            }
+            last = end;
+            pos = end;
+        }
+        return true;
+    }
+
+    // XOR is its own inverse, so the same delta moves a state forwards or backwards one frame
+    void applyDelta(const uint8_t* record, uint32_t length, uint8_t* state){
+        uint32_t pos = 0;
+        uint32_t read = 0;
+        while(read < length){
+            uint16_t skip, runLength;
+            memcpy(&skip, record + read, 2);
+            memcpy(&runLength, record + read + 2, 2);
+            read += 4;
+            pos += skip;
+            for(uint16_t ctr = 0; ctr < runLength; ctr++){
+                state[pos++] ^= record[read++];
+            }
+        }
+    }
+
+    RewindFrame& frameAt(int index){
+        return frames[(first + index) % maxFrames];
+    }
+
+    // Finds room for length bytes after the newest record, wrapping to the start of the arena
+    bool fits(uint32_t length, uint32_t* at){
+        if(count == maxFrames){
+            return false;
+        }
+        if(count == 0){
+            *at = 0;
+            return length <= arenaSize;
+        }
+        uint32_t start = frameAt(0).offset;
+        if(writePos > start){
+            if(writePos + length <= arenaSize){
+                *at = writePos;
+                return true;
+            }
+            *at = 0;
+            return length <= start;
+        }
+        *at = writePos;
+        return writePos + length <= start;
+    }
+
+    // Drops the oldest keyframe together with all deltas that depend on it
+    void evictOldest(){
+        do {
+            first = (first + 1) % maxFrames;
+            count--;
+        } while(count > 0 && !frameAt(0).isKeyframe);
+        if(count == 0){
+            clear();
+        }
+    }
+
+    // Evicts old frames until length bytes fit. A delta needs its base frame,
+    // so this fails for deltas once everything had to be dropped.
+    bool makeRoom(uint32_t length, bool isKeyframe, uint32_t* at){
+        while(!fits(length, at)){
+            if(count == 0){
+                return false;
+            }
+            evictOldest();
+            if(count == 0 && !isKeyframe){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Call once per frame
+    void record(Chip8& cpu){
+        saveState(cpu, next);
+        uint32_t at;
+        bool isKeyframe = count == 0 || sinceKeyframe >= keyframeInterval - 1 || !encodeDelta();
+        if(!isKeyframe && !makeRoom(deltaLength, false, &at)){
+            isKeyframe = true;
+        }
+        if(isKeyframe && !makeRoom(REWIND_STATE_SIZE, true, &at)){
+            return;
+        }
+
+        RewindFrame& frame = frameAt(count);
+        count++;
+        frame.offset = at;
+        frame.isKeyframe = isKeyframe;
+        if(isKeyframe){
+            frame.length = REWIND_STATE_SIZE;
+            memcpy(arena + at, next, REWIND_STATE_SIZE);
+            sinceKeyframe = 0;
+        }
+        else {
+            frame.length = deltaLength;
+            memcpy(arena + at, delta, deltaLength);
+            sinceKeyframe++;
+        }
+        writePos = at + frame.length;
+        memcpy(current, next, REWIND_STATE_SIZE);
+    }
+
+    // Rebuilds current from the newest keyframe and the deltas following it
+    void rebuild(){
+        int key = count - 1;
+        while(!frameAt(key).isKeyframe){
+            key--;
+        }
+        memcpy(current, arena + frameAt(key).offset, REWIND_STATE_SIZE);
+        for(int ctr = key + 1; ctr < count; ctr++){
+            applyDelta(arena + frameAt(ctr).offset, frameAt(ctr).length, current);
+        }
+        sinceKeyframe = count - 1 - key;
+    }
+
+    // Restores the frame before the newest one. Returns false once the history is used up.
+    bool stepBack(Chip8& cpu){
+        if(count < 2){
+            return false;
+        }
+        RewindFrame newest = frameAt(count - 1);
+        count--;
+        writePos = newest.offset;
+        if(newest.isKeyframe){
+            rebuild();
+        }
+        else {
+            applyDelta(arena + newest.offset, newest.length, current);
+            sinceKeyframe--;
+        }
+        loadState(cpu, current);
+        return true;
+    }
+};
+
+#endif
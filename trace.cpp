@@ -0,0 +1,148 @@
+#ifndef TRACE_CPP
+#define TRACE_CPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "chip8.cpp"
+
+#define TRACE_MAGIC 0x52543843      // "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_BLOCK_RECORDS 65536   // records written to the file at once (2 MB)
+
+#define TRACE_I_CHANGED 0x01
+#define TRACE_TICK 0x02             // the 60Hz timers ticked since the previous record
+
+using namespace std;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+} TraceHeader;
+
+// One executed instruction. Fixed width, so record n lives at a known offset in the file.
+typedef struct {
+    uint16_t pc;
+    uint16_t instruction;
+    uint16_t changed;       // bit n set: Vn changed
+    uint16_t i;             // I after the instruction
+    uint16_t writeAddress;
+    uint8_t writeLength;    // bytes written to RAM from writeAddress on, 0 if none
+    uint8_t flags;          // TRACE_I_CHANGED / TRACE_TICK
+    uint8_t v[16];          // V0 to VF after the instruction
+    uint8_t dt;
+    uint8_t st;
+    uint8_t sp;
+    uint8_t unused;
+} TraceRecord;
+
+static_assert(sizeof(TraceRecord) == 32, "TraceRecord should stay 32 bytes");
+
+// Appends a TraceRecord for every instruction run between begin() and end()
+class Tracer {
+    public:
+
+    FILE* file;
+    TraceRecord* buffer;
+    size_t used;
+    bool active;
+    uint8_t v[16];          // registers before the instruction
+    uint16_t i;
+    bool pendingTick;       // the timers ticked in a slot that executed nothing
+
+    Tracer(){
+        file = NULL;
+        buffer = NULL;
+        used = 0;
+        active = false;
+        pendingTick = false;
+    }
+
+    bool start(string filename){
+        file = fopen(filename.c_str(), "wb");
+        if(file == NULL){
+            return false;
+        }
+        TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord), 0};
+        fwrite(&header, sizeof(header), 1, file);
+        buffer = (TraceRecord*)malloc(TRACE_BLOCK_RECORDS * sizeof(TraceRecord));
+        used = 0;
+        pendingTick = false;
+        active = true;
+        return true;
+    }
+
+    void flush(){
+        if(used > 0 && fwrite(buffer, sizeof(TraceRecord), used, file) != used){
+            fprintf(stderr, "Tracer: cannot write the trace, stopping\n");
+            active = false;
+        }
+        used = 0;
+    }
+
+    void stop(){
+        if(file == NULL){
+            return;
+        }
+        flush();
+        fclose(file);
+        free(buffer);
+        file = NULL;
+        active = false;
+    }
+
+    void begin(Chip8& cpu){
+        TraceRecord& record = buffer[used];
+        record.pc = cpu.pc;
+        record.instruction = cpu.fetch(cpu.pc);
+        bool isWrite;
+        uint8_t length;
+        if(cpu.memoryAccess(record.instruction, &record.writeAddress, &length, &isWrite) && isWrite){
+            record.writeLength = length;
+        }
+        else {
+            record.writeAddress = 0;
+            record.writeLength = 0;
+        }
+        record.flags = (cpu.decrementer <= 0 || pendingTick) ? TRACE_TICK : 0;
+        pendingTick = false;
+        memcpy(v, cpu.v, 16);
+        i = cpu.i;
+    }
+
+    void end(Chip8& cpu){
+        TraceRecord& record = buffer[used];
+        // Chip8::run() used up the slot of a waiting spin loop without executing it, there is nothing to record.
+        // An executed instruction at the head of such a loop always moves the PC.
+        if(record.pc == cpu.pc && cpu.skipIdleLoops && cpu.isIdleLoop()){
+            pendingTick = (record.flags & TRACE_TICK) != 0;
+            return;
+        }
+        record.changed = 0;
+        for(int reg = 0; reg < 16; reg++){
+            if(v[reg] != cpu.v[reg]){
+                record.changed |= 1 << reg;
+            }
+        }
+        if(i != cpu.i){
+            record.flags |= TRACE_I_CHANGED;
+        }
+        record.i = cpu.i;
+        memcpy(record.v, cpu.v, 16);
+        record.dt = cpu.dt;
+        record.st = cpu.st;
+        record.sp = cpu.sp;
+        record.unused = 0;
+        used++;
+        if(used == TRACE_BLOCK_RECORDS){
+            flush();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.cpp"
+
+using namespace std;
+
+void printRecord(const TraceRecord* records, uint64_t index){
+    const TraceRecord& record = records[index];
+    printf("#%llu PC=%03X [%04X] I=%03X SP=%X DT=%02X ST=%02X%s", (unsigned long long)index, record.pc, record.instruction,
+        record.i, record.sp, record.dt, record.st, (record.flags & TRACE_TICK) ? " tick" : "");
+    for(int reg = 0; reg < 16; reg++){
+        if(record.changed & (1 << reg)){
+            printf(" V%X=%02X", reg, record.v[reg]);
+        }
+    }
+    if(record.flags & TRACE_I_CHANGED){
+        printf(" I changed");
+    }
+    if(record.writeLength > 0){
+        printf(" wrote %03X-%03X", record.writeAddress, (record.writeAddress + record.writeLength - 1) & 0x0FFF);
+    }
+    printf("\n");
+}
+
+// "V3" -> 3, "I" -> 16, -1 for anything else
+int parseRegister(const char* name){
+    if((name[0] == 'I' || name[0] == 'i') && name[1] == '\0'){
+        return 16;
+    }
+    if((name[0] == 'V' || name[0] == 'v') && name[1] != '\0' && name[2] == '\0'){
+        char* end;
+        long reg = strtol(name + 1, &end, 16);
+        return *end == '\0' ? (int)reg : -1;
+    }
+    return -1;
+}
+
+bool changes(const TraceRecord& record, int reg){
+    return reg == 16 ? (record.flags & TRACE_I_CHANGED) != 0 : (record.changed & (1 << reg)) != 0;
+}
+
+bool writes(const TraceRecord& record, uint16_t address){
+    return record.writeLength > 0 && ((address - record.writeAddress) & 0x0FFF) < record.writeLength;
+}
+
+int main(int argc, char** argv){
+    if(argc < 3){
+        printf("usage: %s <trace> info | at <n> | last <Vx|I> | changes <Vx|I> | writes <addr> | lastwrite <addr> | pc <addr>\n", argv[0]);
+        return 1;
+    }
+    int fd = open(argv[1], O_RDONLY);
+    struct stat stat_buf;
+    if(fd < 0 || fstat(fd, &stat_buf) != 0 || (size_t)stat_buf.st_size < sizeof(TraceHeader)){
+        printf("cannot open %s\n", argv[1]);
+        return 1;
+    }
+    // The file is mapped, not read: pages are only loaded while a query touches them
+    const uint8_t* data = (const uint8_t*)mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED){
+        printf("cannot map %s\n", argv[1]);
+        return 1;
+    }
+    const TraceHeader* header = (const TraceHeader*)data;
+    if(header->magic != TRACE_MAGIC || header->version != TRACE_VERSION || header->recordSize != sizeof(TraceRecord)){
+        printf("%s is not a trace file\n", argv[1]);
+        return 1;
+    }
+    const TraceRecord* records = (const TraceRecord*)(data + sizeof(TraceHeader));
+    uint64_t count = (stat_buf.st_size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+
+    string query = argv[2];
+    const char* argument = argc > 3 ? argv[3] : "";
+    int reg = parseRegister(argument);
+    uint16_t address = (uint16_t)strtol(argument, NULL, 16) & 0x0FFF;
+
+    if(query == "info"){
+        printf("%llu instructions\n", (unsigned long long)count);
+    }
+    else if(query == "at"){
+        uint64_t index = strtoull(argument, NULL, 10);
+        if(index < count){
+            printRecord(records, index);
+        }
+    }
+    else if(query == "last" && reg >= 0){
+        for(uint64_t index = count; index > 0; index--){
+            if(changes(records[index - 1], reg)){
+                printRecord(records, index - 1);
+                break;
+            }
+        }
+    }
+    else if(query == "changes" && reg >= 0){
+        madvise((void*)data, stat_buf.st_size, MADV_SEQUENTIAL);
+        for(uint64_t index = 0; index < count; index++){
+            if(changes(records[index], reg)){
+                printRecord(records, index);
+            }
+        }
+    }
+    else if(query == "writes"){
+        madvise((void*)data, stat_buf.st_size, MADV_SEQUENTIAL);
+        for(uint64_t index = 0; index < count; index++){
+            if(writes(records[index], address)){
+                printRecord(records, index);
+            }
+        }
+    }
+    else if(query == "lastwrite"){
+        for(uint64_t index = count; index > 0; index--){
+            if(writes(records[index - 1], address)){
+                printRecord(records, index - 1);
+                break;
+            }
+        }
+    }
+    else if(query == "pc"){
+        madvise((void*)data, stat_buf.st_size, MADV_SEQUENTIAL);
+        uint64_t hits = 0, first = 0, last = 0;
+        for(uint64_t index = 0; index < count; index++){
+            if(records[index].pc == address){
+                if(hits == 0){
+                    first = index;
+                }
+                last = index;
+                hits++;
+            }
+        }
+        printf("%03X executed %llu times", address, (unsigned long long)hits);
+        if(hits > 0){
+            printf(", first at #%llu, last at #%llu", (unsigned long long)first, (unsigned long long)last);
+        }
+        printf("\n");
+    }
+    else {
+        printf("unknown query %s\n", query.c_str());
+        return 1;
+    }
+    munmap((void*)data, stat_buf.st_size);
+    close(fd);
+    return 0;
+}